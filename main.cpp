@@ -5,8 +5,23 @@
 #include <sstream>
 #include <tuple>
 #include <Windows.h>
+#include <Psapi.h>
 #include <algorithm>
 #include <array>
+#include <charconv>
+#include <chrono>
+#include <thread>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <emmintrin.h>
+#include <cstdio>
+#include <io.h>
+#include <fcntl.h>
 
 extern "C"
 {
@@ -16,16 +31,31 @@ extern "C"
 // kilometers per astronomic unit
 double AU = 149597870.7;
 
-std::vector<std::array<int, 3>> major_body_colors = {
-	{255, 245, 200},
-	{169, 169, 169},
-	{255, 238, 219},
-	{100, 149, 237},
-	{188, 39, 50},
-	{218, 165, 105},
-	{210, 180, 140},
-	{173, 216, 230},
-	{72, 61, 139}
+// the same value pi_c() returns, but a plain constant, so code off the main thread doesn't have to call into CSPICE for it
+constexpr double PI = 3.14159265358979323846;
+
+// J2000 equatorial -> J2000 ecliptic, a fixed rotation, so it is fetched from SPICE once after loading the kernels
+SpiceDouble equ_ecl_rot[3][3];
+
+// CSPICE is not thread-safe, every SPICE call made while other threads are running has to hold this
+std::mutex spice_mutex;
+
+// colors are packed 8-bit RGBA with red in the lowest byte, so a pixel sits in memory as R, G, B, A
+uint32_t packRGB(int r, int g, int b)
+{
+	return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | 0xFF000000u;
+}
+
+std::vector<uint32_t> major_body_colors = {
+	packRGB(255, 245, 200),
+	packRGB(169, 169, 169),
+	packRGB(255, 238, 219),
+	packRGB(100, 149, 237),
+	packRGB(188, 39, 50),
+	packRGB(218, 165, 105),
+	packRGB(210, 180, 140),
+	packRGB(173, 216, 230),
+	packRGB(72, 61, 139)
 };
 
 std::vector<double> major_body_radii = {
@@ -42,12 +72,12 @@ std::vector<double> major_body_radii = {
 
 double rad2deg(double x)
 {
-	return x * 180 / pi_c();
+	return x * 180 / PI;
 }
 
 double deg2rad(double x)
 {
-	return x * pi_c() / 180;
+	return x * PI / 180;
 }
 
 struct Vec3 // extremely self-explanatory
@@ -120,24 +150,24 @@ struct Vec3 // extremely self-explanatory
 		return Vec3(-x, -y, -z);
 	}
 
-	Vec3 cross(const Vec3& other)
+	Vec3 cross(const Vec3& other) const
 	{
 		return Vec3(y * other.z - z * other.y,
 			z * other.x - x * other.z,
 			x * other.y - y * other.x);
 	}
 
-	double dot(const Vec3& other)
+	double dot(const Vec3& other) const
 	{
 		return x * other.x + y * other.y + z * other.z;
 	}
 
-	Vec3 normalized()
+	Vec3 normalized() const
 	{
 		return Vec3(x, y, z) / Vec3(x, y, z).mag();
 	}
 
-	double mag()
+	double mag() const
 	{
 		return sqrt(x * x + y * y + z * z);
 	}
@@ -154,10 +184,135 @@ public:
 	std::string desig;
 	double JD;
 	std::string datetime;
+	double et; // ephemeris time, converted once while reading
 	Vec3 p;
 	Vec3 v;
 };
 
+// a patch of sky holding a contiguous run of stars, bounded by a cone around its center
+struct SkyTile
+{
+	Vec3 center; // unit vector, J2000 ecliptic
+	double sin_radius; // sine of the cone's half-angle, every star in the tile is within it
+	int first_star;
+	int N_stars;
+};
+
+// background stars, sorted from brightest to faintest
+// once bucketed into sky tiles, the brightest-first order holds within each tile instead
+struct Starfield
+{
+	std::vector<double> mags;
+	std::vector<double> RAs; // deg, only kept until computeStarDirections() has run
+	std::vector<double> DECs;
+	std::vector<Vec3> dirs; // unit vectors in J2000 ecliptic, which is what gets drawn
+	double mag_limit = 6; // stars fainter than this are neither loaded nor drawn
+	std::vector<SkyTile> tiles; // only non-empty tiles are kept
+};
+
+// the bounding box of a run of polyline points, which also holds the segments between them
+// neighbouring chunks share their end point, so every segment lies in exactly one chunk
+struct PolylineChunk
+{
+	Vec3 lo;
+	Vec3 hi;
+	int first; // first and last point, inclusive
+	int last;
+};
+
+// a sampled curve, structure-of-arrays so whole orbits can be projected a couple of points at a time
+// the chunk boxes let a camera skip the parts it can't see, computeChunkBounds() has to run after filling it
+struct Polyline
+{
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> z;
+	std::vector<PolylineChunk> chunks;
+	Vec3 lo; // the whole curve
+	Vec3 hi;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+};
+
+const int POLYLINE_CHUNKS = 16; // 45 points each for a 720-point orbit
+
+// splits the polyline into N_chunks runs of segments and boxes each of them, plus the whole curve
+void computeChunkBounds(Polyline& line, int N_chunks = POLYLINE_CHUNKS)
+{
+	line.chunks.clear();
+	int N_segments = (int)line.size() - 1;
+	if (N_segments < 1)
+	{
+		return;
+	}
+	N_chunks = min(N_chunks, N_segments);
+
+	for (int idx_chunk = 0; idx_chunk < N_chunks; idx_chunk++)
+	{
+		PolylineChunk chunk;
+		chunk.first = (long long)N_segments * idx_chunk / N_chunks;
+		chunk.last = (long long)N_segments * (idx_chunk + 1) / N_chunks;
+		chunk.lo = Vec3(line.x[chunk.first], line.y[chunk.first], line.z[chunk.first]);
+		chunk.hi = chunk.lo;
+		for (int idx_point = chunk.first + 1; idx_point <= chunk.last; idx_point++)
+		{
+			chunk.lo.x = min(chunk.lo.x, line.x[idx_point]);
+			chunk.lo.y = min(chunk.lo.y, line.y[idx_point]);
+			chunk.lo.z = min(chunk.lo.z, line.z[idx_point]);
+			chunk.hi.x = max(chunk.hi.x, line.x[idx_point]);
+			chunk.hi.y = max(chunk.hi.y, line.y[idx_point]);
+			chunk.hi.z = max(chunk.hi.z, line.z[idx_point]);
+		}
+
+		if (idx_chunk == 0)
+		{
+			line.lo = chunk.lo;
+			line.hi = chunk.hi;
+		}
+		else
+		{
+			line.lo = Vec3(min(line.lo.x, chunk.lo.x), min(line.lo.y, chunk.lo.y), min(line.lo.z, chunk.lo.z));
+			line.hi = Vec3(max(line.hi.x, chunk.hi.x), max(line.hi.y, chunk.hi.y), max(line.hi.z, chunk.hi.z));
+		}
+		line.chunks.push_back(chunk);
+	}
+}
+
+// a two-body orbit as a curve in the true anomaly, everything about it that doesn't depend on how finely it gets
+// sampled (see getOrbitCurve())
+struct OrbitCurve
+{
+	double semi_latus; // a * (1 - e^2)
+	double e;
+	Vec3 P; // perifocal -> ecliptic, the periapsis direction and 90 degrees ahead of it
+	Vec3 Q;
+	double nu_start; // the drawn range of true anomalies
+	double nu_end;
+	bool closed; // the end point is the start point again
+};
+
+struct Population;
+
+// what every view of one epoch draws: the starfield, shared by all epochs, plus this epoch's body states and orbits
+// built once per epoch and handed to each view by const reference
+struct Scene
+{
+	const Starfield* starfield;
+	const Population* population = nullptr; // minor planets drawn as points, if any
+	State st;
+	Vec3 mp_pos; // J2000 ecliptic
+	Vec3 mp_vel;
+	std::vector<Vec3> major_pos; // J2000 ecliptic, indexed like getSolarSystemStates()
+	std::vector<Vec3> major_vel;
+	Polyline mp_orbit;
+	std::vector<Polyline> major_orbits;
+	OrbitCurve mp_curve; // what the orbit polylines were sampled from, for per-camera tessellation
+	std::vector<OrbitCurve> major_curves;
+};
+
 using StateMatrix = std::array<std::array<std::array<double, 3>, 2>, 9>;
 
 // Constant: font8x8_basic
@@ -331,19 +486,21 @@ void loadAllKernels(const std::string& directory)
 	::FindClose(hFind);
 }
 
+const char* major_body_names[9] = {
+	"SUN",                 // index 0
+	"MERCURY BARYCENTER",  // index 1
+	"VENUS BARYCENTER",    // index 2
+	"EARTH BARYCENTER",    // index 3
+	"MARS BARYCENTER",     // index 4
+	"JUPITER BARYCENTER",  // index 5
+	"SATURN BARYCENTER",   // index 6
+	"URANUS BARYCENTER",   // index 7
+	"NEPTUNE BARYCENTER"   // index 8
+};
+
 StateMatrix getSolarSystemStates(SpiceDouble et)
 {
-	const char* bodies[9] = {
-		"SUN",                 // index 0
-		"MERCURY BARYCENTER",  // index 1
-		"VENUS BARYCENTER",    // index 2
-		"EARTH BARYCENTER",    // index 3
-		"MARS BARYCENTER",     // index 4
-		"JUPITER BARYCENTER",  // index 5
-		"SATURN BARYCENTER",   // index 6
-		"URANUS BARYCENTER",   // index 7
-		"NEPTUNE BARYCENTER"   // index 8
-	};
+	const char** bodies = major_body_names;
 
 	StateMatrix states{};
 
@@ -352,7 +509,10 @@ StateMatrix getSolarSystemStates(SpiceDouble et)
 		SpiceDouble state[6];
 		SpiceDouble lt;
 
-		spkezr_c(bodies[i], et, "J2000", "NONE", "SOLAR SYSTEM BARYCENTER", state, &lt);
+		{
+			std::lock_guard<std::mutex> spice_lock(spice_mutex);
+			spkezr_c(bodies[i], et, "J2000", "NONE", "SOLAR SYSTEM BARYCENTER", state, &lt);
+		}
 
 		for (int j = 0; j < 3; ++j)
 		{
@@ -364,7 +524,373 @@ StateMatrix getSolarSystemStates(SpiceDouble et)
 	return states;
 }
 
+// degree of the Chebyshev series fitted to each ephemeris segment
+const int EPHEM_CHEB_DEGREE = 12;
+
+// major body state approximation over [et_start, et_end]
+struct ChebyshevSegment
+{
+	double et_start;
+	double et_end;
+	double coeffs[6][EPHEM_CHEB_DEGREE + 1]; // x, y, z (km), vx, vy, vz (km/s), J2000
+};
+
+// sums a Chebyshev series at x in [-1, 1] using Clenshaw's recurrence
+double evalChebyshev(const double* coeffs, int degree, double x)
+{
+	double b1 = 0, b2 = 0;
+	for (int j = degree; j >= 1; j--)
+	{
+		double b0 = 2 * x * b1 - b2 + coeffs[j];
+		b2 = b1;
+		b1 = b0;
+	}
+
+	return x * b1 - b2 + coeffs[0];
+}
+
+enum class EphemerisMode
+{
+	SPICE,  // ask spkezr_c for every epoch
+	CACHE,  // evaluate the fitted Chebyshev segments
+	VERIFY  // evaluate the segments, but also ask SPICE and keep track of the worst deviation
+};
+
+// the span covered by the loaded SPK files for all nine major bodies, around et
+// (each body's coverage interval containing et, intersected), returns false if some body isn't covered at et
+bool getSpkCoverage(double et, double& et_start, double& et_end)
+{
+	const int FILE_LEN = 512;
+	const int TYPE_LEN = 32;
+
+	std::lock_guard<std::mutex> spice_lock(spice_mutex);
+
+	SpiceInt N_files;
+	ktotal_c("SPK", &N_files);
+
+	et_start = -std::numeric_limits<double>::infinity();
+	et_end = std::numeric_limits<double>::infinity();
+	for (int idx_body = 0; idx_body < 9; idx_body++)
+	{
+		SpiceInt body_id;
+		SpiceBoolean found;
+		bodn2c_c(major_body_names[idx_body], &body_id, &found);
+		if (!found)
+		{
+			return false;
+		}
+
+		SPICEDOUBLE_CELL(coverage, 2000);
+		scard_c(0, &coverage);
+		for (int idx_file = 0; idx_file < N_files; idx_file++)
+		{
+			SpiceChar file[FILE_LEN], type[TYPE_LEN], source[FILE_LEN];
+			SpiceInt handle;
+			kdata_c(idx_file, "SPK", FILE_LEN, TYPE_LEN, FILE_LEN, file, type, source, &handle, &found);
+			if (found)
+			{
+				spkcov_c(file, body_id, &coverage);
+			}
+		}
+
+		bool covered = false;
+		for (int idx_interval = 0; idx_interval < wncard_c(&coverage); idx_interval++)
+		{
+			SpiceDouble left, right;
+			wnfetd_c(&coverage, idx_interval, &left, &right);
+			if (left <= et && et <= right)
+			{
+				et_start = max(et_start, left);
+				et_end = min(et_end, right);
+				covered = true;
+				break;
+			}
+		}
+
+		if (!covered)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Chebyshev approximation of getSolarSystemStates()
+// time is cut into fixed blocks, and a block is fitted the first time an epoch falls into it. each body's fit
+// is split in half until it is within tolerance_km of SPICE at the check points between the fit nodes (and at
+// both ends). velocities are held to the same bound, expressed as the position error they would cause in the
+// drawn orbit (about 2 |r| |dv| / |v|)
+// fits stay inside the SPK coverage around the first epoch asked for, and a block too sparse in epochs to pay
+// for its fit is left to SPICE (see fitBlock())
+class EphemerisCache
+{
+public:
+	EphemerisMode mode;
+	double tolerance_km;
+	double block_length; // s
+	double min_segment_length; // s, segments won't be split below this even if the fit is still off
+
+	// fitting statistics
+	int N_spice_calls = 0;
+	int N_segments = 0;
+	int N_spice_blocks = 0; // blocks not worth fitting, looked up in SPICE instead
+	double max_fit_error = 0; // km, worst check point error among accepted segments
+
+	// verification statistics, filled in VERIFY mode
+	int N_verified = 0;
+	double max_pos_deviation[9] = {};
+	double max_vel_deviation[9] = {};
+
+	EphemerisCache(EphemerisMode mode_p = EphemerisMode::CACHE, double tolerance_km_p = 1.0)
+	{
+		mode = mode_p;
+		tolerance_km = tolerance_km_p;
+		block_length = 32 * 86400.0;
+		min_segment_length = 3600.0;
+	}
+
+	StateMatrix getStates(SpiceDouble et)
+	{
+		if (mode == EphemerisMode::SPICE)
+		{
+			return getSolarSystemStates(et);
+		}
+
+		if (N_epochs_seen == 0)
+		{
+			et_first_seen = et;
+			if (!getSpkCoverage(et, fit_start, fit_end))
+			{
+				// nothing to go on, don't clamp
+				fit_start = -std::numeric_limits<double>::infinity();
+				fit_end = std::numeric_limits<double>::infinity();
+			}
+		}
+		N_epochs_seen++;
+		et_last_seen = et;
+
+		if (et < fit_start || et > fit_end)
+		{
+			return getSolarSystemStates(et);
+		}
+
+		StateMatrix states{};
+
+		long long idx_block = (long long)floor(et / block_length);
+		std::map<long long, std::array<std::vector<ChebyshevSegment>, 9>>::iterator block = blocks.find(idx_block);
+		if (block == blocks.end())
+		{
+			// with one epoch seen there is no telling how dense they are yet
+			if (N_epochs_seen < 2 && mode != EphemerisMode::VERIFY)
+			{
+				return getSolarSystemStates(et);
+			}
+			block = blocks.emplace(idx_block, fitBlock(idx_block)).first;
+		}
+
+		// not fitted, see fitBlock()
+		if (block->second[0].empty())
+		{
+			return getSolarSystemStates(et);
+		}
+
+		for (int idx_body = 0; idx_body < 9; idx_body++)
+		{
+			const std::vector<ChebyshevSegment>& segments = block->second[idx_body];
+
+			// last segment starting at or before et
+			int idx_seg = 0;
+			int lo = 0, hi = (int)segments.size() - 1;
+			while (lo <= hi)
+			{
+				int mid = (lo + hi) / 2;
+				if (segments[mid].et_start <= et)
+				{
+					idx_seg = mid;
+					lo = mid + 1;
+				}
+				else
+				{
+					hi = mid - 1;
+				}
+			}
+
+			const ChebyshevSegment& seg = segments[idx_seg];
+			double x = (2 * et - seg.et_start - seg.et_end) / (seg.et_end - seg.et_start);
+
+			for (int j = 0; j < 3; ++j)
+			{
+				states[idx_body][0][j] = evalChebyshev(seg.coeffs[j], EPHEM_CHEB_DEGREE, x);
+				states[idx_body][1][j] = evalChebyshev(seg.coeffs[j + 3], EPHEM_CHEB_DEGREE, x);
+			}
+		}
+
+		if (mode == EphemerisMode::VERIFY)
+		{
+			StateMatrix spice_states = getSolarSystemStates(et);
+			for (int idx_body = 0; idx_body < 9; idx_body++)
+			{
+				Vec3 dp = Vec3(states[idx_body][0]) - Vec3(spice_states[idx_body][0]);
+				Vec3 dv = Vec3(states[idx_body][1]) - Vec3(spice_states[idx_body][1]);
+				max_pos_deviation[idx_body] = max(max_pos_deviation[idx_body], dp.mag());
+				max_vel_deviation[idx_body] = max(max_vel_deviation[idx_body], dv.mag());
+			}
+			N_verified++;
+		}
+
+		return states;
+	}
+
+	void printSummary()
+	{
+		if (mode == EphemerisMode::SPICE)
+		{
+			return;
+		}
+
+		std::cout << "Ephemeris cache: " << blocks.size() - N_spice_blocks << " blocks, " << N_segments << " segments, "
+			<< N_spice_calls << " SPICE calls, worst fit error " << max_fit_error << " km (tolerance " << tolerance_km << " km)";
+		if (N_spice_blocks > 0)
+		{
+			std::cout << ", " << N_spice_blocks << " blocks too sparse to fit, looked up in SPICE";
+		}
+		std::cout << "\n";
+
+		if (mode == EphemerisMode::VERIFY)
+		{
+			std::cout << "Ephemeris verification against SPICE over " << N_verified << " epochs:\n";
+			for (int idx_body = 0; idx_body < 9; idx_body++)
+			{
+				std::cout << "    " << major_body_names[idx_body] << ": max position deviation " << max_pos_deviation[idx_body]
+					<< " km, max velocity deviation " << max_vel_deviation[idx_body] << " km/s\n";
+			}
+		}
+	}
+
+private:
+	std::map<long long, std::array<std::vector<ChebyshevSegment>, 9>> blocks;
+
+	// SPK coverage around the first epoch, fits are clamped to it
+	double fit_start = -std::numeric_limits<double>::infinity();
+	double fit_end = std::numeric_limits<double>::infinity();
+
+	// the epochs asked for so far, for their density
+	int N_epochs_seen = 0;
+	double et_first_seen = 0;
+	double et_last_seen = 0;
+
+	void getSpiceState(int idx_body, double et, double state[6])
+	{
+		SpiceDouble lt;
+		std::lock_guard<std::mutex> spice_lock(spice_mutex);
+		spkezr_c(major_body_names[idx_body], et, "J2000", "NONE", "SOLAR SYSTEM BARYCENTER", state, &lt);
+		N_spice_calls++;
+	}
+
+	std::array<std::vector<ChebyshevSegment>, 9> fitBlock(long long idx_block)
+	{
+		std::array<std::vector<ChebyshevSegment>, 9> block;
+
+		double et_start = max(idx_block * block_length, fit_start);
+		double et_end = min((idx_block + 1) * block_length, fit_end);
+
+		// a fit costs 9 (2 N_nodes + 1) SPICE calls against 9 per epoch without one, so a block expected to hold
+		// fewer than 2 N_nodes + 1 epochs at the mean spacing seen so far isn't fitted at all
+		// verification wants the fit whatever it costs
+		bool worth_fitting = et_end > et_start;
+		if (mode != EphemerisMode::VERIFY)
+		{
+			double spacing = abs(et_last_seen - et_first_seen) / (N_epochs_seen - 1);
+			double N_block_epochs = spacing > 0 ? (et_end - et_start) / spacing : 0;
+			worth_fitting = worth_fitting && N_block_epochs >= 2 * (EPHEM_CHEB_DEGREE + 1) + 1;
+		}
+
+		if (!worth_fitting)
+		{
+			N_spice_blocks++;
+			return block;
+		}
+
+		for (int idx_body = 0; idx_body < 9; idx_body++)
+		{
+			fitSegment(idx_body, et_start, et_end, block[idx_body]);
+		}
+
+		return block;
+	}
+
+	void fitSegment(int idx_body, double et_start, double et_end, std::vector<ChebyshevSegment>& segments)
+	{
+		const int N_nodes = EPHEM_CHEB_DEGREE + 1;
+		double et_mid = 0.5 * (et_start + et_end);
+		double et_half = 0.5 * (et_end - et_start);
+
+		// sample at the Chebyshev nodes
+		double samples[N_nodes][6];
+		for (int k = 0; k < N_nodes; k++)
+		{
+			getSpiceState(idx_body, et_mid + et_half * cos(pi_c() * (k + 0.5) / N_nodes), samples[k]);
+		}
+
+		ChebyshevSegment seg;
+		seg.et_start = et_start;
+		seg.et_end = et_end;
+
+		for (int comp = 0; comp < 6; comp++)
+		{
+			for (int j = 0; j < N_nodes; j++)
+			{
+				double sum = 0;
+				for (int k = 0; k < N_nodes; k++)
+				{
+					sum += samples[k][comp] * cos(pi_c() * j * (k + 0.5) / N_nodes);
+				}
+				seg.coeffs[comp][j] = 2.0 * sum / N_nodes;
+			}
+			seg.coeffs[comp][0] *= 0.5;
+		}
+
+		// check the fit halfway between the nodes, both ends included
+		double fit_error = 0;
+		for (int k = 0; k <= N_nodes; k++)
+		{
+			double x = cos(pi_c() * k / N_nodes);
+			double truth[6];
+			// rounding can put the ends a hair outside the segment, and so outside the SPK coverage it was clamped to
+			getSpiceState(idx_body, min(et_end, max(et_start, et_mid + et_half * x)), truth);
+
+			Vec3 r = Vec3(truth[0], truth[1], truth[2]);
+			Vec3 v = Vec3(truth[3], truth[4], truth[5]);
+			Vec3 dr = Vec3(evalChebyshev(seg.coeffs[0], EPHEM_CHEB_DEGREE, x), evalChebyshev(seg.coeffs[1], EPHEM_CHEB_DEGREE, x),
+				evalChebyshev(seg.coeffs[2], EPHEM_CHEB_DEGREE, x)) - r;
+			Vec3 dv = Vec3(evalChebyshev(seg.coeffs[3], EPHEM_CHEB_DEGREE, x), evalChebyshev(seg.coeffs[4], EPHEM_CHEB_DEGREE, x),
+				evalChebyshev(seg.coeffs[5], EPHEM_CHEB_DEGREE, x)) - v;
+
+			double orbit_error = 0;
+			if (v.mag() > 0)
+			{
+				orbit_error = 2 * r.mag() * dv.mag() / v.mag();
+			}
+
+			fit_error = max(fit_error, max(dr.mag(), orbit_error));
+		}
+
+		if (fit_error > tolerance_km && et_end - et_start > 2 * min_segment_length)
+		{
+			fitSegment(idx_body, et_start, et_mid, segments);
+			fitSegment(idx_body, et_mid, et_end, segments);
+			return;
+		}
+
+		max_fit_error = max(max_fit_error, fit_error);
+		N_segments++;
+		segments.push_back(seg);
+	}
+};
+
 // feed ecliptic state vectors to this!!
+// (getKeplerElements() and getKeplerElementsBatch() give the same without allocating, this is their reference)
 std::vector<double> eclStateVector2Kepler(Vec3 r, Vec3 v, double mu = 1.3271244004193938E+11)
 {
 	double r_mag = r.mag();
@@ -469,6 +995,191 @@ std::vector<double> eclStateVector2Kepler(Vec3 r, Vec3 v, double mu = 1.32712440
 
 }
 
+// what eclStateVector2Kepler() returns, without the heap
+struct KeplerElements
+{
+	double sma; // km
+	double e;
+	double inclination; // deg
+	double omega; // deg, longitude of the ascending node
+	double arg_periapsis; // deg
+	double true_anomaly; // deg
+	double mean_anomaly; // deg
+};
+
+// eclStateVector2Kepler(), step for step, but with no branches on the data: every case is computed and the right one
+// picked, so getKeplerElementsBatch() can run it down vector lanes (the cases not picked can be NaN, nothing traps)
+inline KeplerElements computeKeplerElements(double rx, double ry, double rz, double vx, double vy, double vz, double mu)
+{
+	double r_mag = sqrt(rx * rx + ry * ry + rz * rz);
+	double v_mag = sqrt(vx * vx + vy * vy + vz * vz);
+
+	double hx = ry * vz - rz * vy;
+	double hy = rz * vx - rx * vz;
+	double hz = rx * vy - ry * vx;
+	double h_mag = sqrt(hx * hx + hy * hy + hz * hz);
+
+	// node vector, z x h
+	double nx = -hy;
+	double ny = hx;
+	double n_mag = sqrt(nx * nx + ny * ny);
+
+	double inv_mu = 1 / mu;
+	double ex = ((vy * hz - vz * hy) - rx * mu / r_mag) * inv_mu;
+	double ey = ((vz * hx - vx * hz) - ry * mu / r_mag) * inv_mu;
+	double ez = ((vx * hy - vy * hx) - rz * mu / r_mag) * inv_mu;
+	double e = sqrt(ex * ex + ey * ey + ez * ez);
+
+	KeplerElements elems;
+	elems.e = e;
+	elems.inclination = acos(hz / h_mag) * 180 / PI;
+
+	double omega = acos(nx / n_mag) * 180 / PI;
+	omega = ny < 0 ? 360 - omega : omega;
+	elems.omega = n_mag != 0 ? omega : 0;
+
+	double arg_periapsis = acos((nx * ex + ny * ey) / (n_mag * e)) * 180 / PI;
+	arg_periapsis = ez < 0 ? 360 - arg_periapsis : arg_periapsis;
+	elems.arg_periapsis = n_mag != 0 && e != 0 ? arg_periapsis : 0;
+
+	// a circular orbit measures it from the velocity instead, and doesn't flip it
+	double cos_nu = (ex * rx + ey * ry + ez * rz) / (e * r_mag);
+	double cos_nu_circular = (rx / r_mag) * (vx / v_mag) + (ry / r_mag) * (vy / v_mag) + (rz / r_mag) * (vz / v_mag);
+	double nu = acos(e != 0 ? cos_nu : cos_nu_circular) * 180 / PI;
+	nu = e != 0 && rx * vx + ry * vy + rz * vz < 0 ? 360 - nu : nu;
+	elems.true_anomaly = nu;
+
+	double specific_energy = v_mag * v_mag / 2 - mu / r_mag;
+	elems.sma = abs(e - 1) > 1e-8 ? -mu / (2 * specific_energy) : 999999;
+
+	// both cases take tan(E / 2) or tanh(F / 2) from tan(nu / 2), the sine and hyperbolic sine then follow from that
+	// without another call: sin(E) = 2 t / (1 + t^2), sinh(F) = 2 t / (1 - t^2) and F = log(1 + 2 t / (1 - t))
+	// (close to parabolic that drifts from the reference by more than 1e-12, see getMeanAnomalyNearParabolic())
+	double tan_half_nu = tan(nu * PI / 180 / 2);
+
+	double t_E = tan_half_nu * sqrt((1 - e) / (1 + e));
+	double E = 2 * atan(t_E);
+	E = E < 0 ? E + 2 * PI : E;
+	double mean_elliptic = (E - e * (2 * t_E / (1 + t_E * t_E))) * 180 / PI;
+
+	double t_F = tan_half_nu * sqrt((e - 1) / (e + 1));
+	double F = log1p(2 * t_F / (1 - t_F));
+	double mean_hyperbolic = (e * (2 * t_F / (1 - t_F * t_F)) - F) * 180 / PI;
+
+	elems.mean_anomaly = e < 1 ? mean_elliptic : (e > 1 ? mean_hyperbolic : -1.0);
+
+	return elems;
+}
+
+const double NEAR_PARABOLIC = 0.05; // |e - 1| below which the mean anomaly is redone the way the reference does it
+
+// M = E - e sin(E) or e sinh(F) - F cancels down to (1 - e) times the anomaly near periapsis, so close to e = 1 the
+// last bits of sin(E) and sinh(F) show up in the result, and they have to be the ones eclStateVector2Kepler() gets
+double getMeanAnomalyNearParabolic(double e, double true_anomaly)
+{
+	double tan_half_nu = tan(true_anomaly * PI / 180 / 2);
+	if (e < 1)
+	{
+		double E = 2 * atan(tan_half_nu * sqrt((1 - e) / (1 + e)));
+		if (E < 0)
+		{
+			E = E + 2 * PI;
+		}
+		return (E - e * sin(E)) * 180 / PI;
+	}
+	else if (e > 1)
+	{
+		double F = 2 * atanh(tan_half_nu * sqrt((e - 1) / (e + 1)));
+		return (e * sinh(F) - F) * 180 / PI;
+	}
+	return -1.0;
+}
+
+KeplerElements getKeplerElements(const Vec3& r, const Vec3& v, double mu = 1.3271244004193938E+11)
+{
+	KeplerElements elems = computeKeplerElements(r.x, r.y, r.z, v.x, v.y, v.z, mu);
+	if (abs(elems.e - 1) < NEAR_PARABOLIC)
+	{
+		elems.mean_anomaly = getMeanAnomalyNearParabolic(elems.e, elems.true_anomaly);
+	}
+	return elems;
+}
+
+// ecliptic state vectors of a whole object list, one array per component
+struct StateVectorBatch
+{
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> z;
+	std::vector<double> vx;
+	std::vector<double> vy;
+	std::vector<double> vz;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+};
+
+struct KeplerElementsBatch
+{
+	std::vector<double> sma;
+	std::vector<double> e;
+	std::vector<double> inclination;
+	std::vector<double> omega;
+	std::vector<double> arg_periapsis;
+	std::vector<double> true_anomaly;
+	std::vector<double> mean_anomaly;
+
+	void resize(size_t N)
+	{
+		sma.resize(N);
+		e.resize(N);
+		inclination.resize(N);
+		omega.resize(N);
+		arg_periapsis.resize(N);
+		true_anomaly.resize(N);
+		mean_anomaly.resize(N);
+	}
+};
+
+// converts every state in the batch, out only reallocates when it has to grow
+// elliptic and hyperbolic states can be mixed freely, there is nothing to mispredict in the main loop
+void getKeplerElementsBatch(const StateVectorBatch& states, KeplerElementsBatch& out, double mu = 1.3271244004193938E+11)
+{
+	int N_states = (int)states.size();
+	out.resize(N_states);
+
+	const double* x = states.x.data();
+	const double* y = states.y.data();
+	const double* z = states.z.data();
+	const double* vx = states.vx.data();
+	const double* vy = states.vy.data();
+	const double* vz = states.vz.data();
+
+	for (int idx_state = 0; idx_state < N_states; idx_state++)
+	{
+		KeplerElements elems = computeKeplerElements(x[idx_state], y[idx_state], z[idx_state], vx[idx_state], vy[idx_state], vz[idx_state], mu);
+		out.sma[idx_state] = elems.sma;
+		out.e[idx_state] = elems.e;
+		out.inclination[idx_state] = elems.inclination;
+		out.omega[idx_state] = elems.omega;
+		out.arg_periapsis[idx_state] = elems.arg_periapsis;
+		out.true_anomaly[idx_state] = elems.true_anomaly;
+		out.mean_anomaly[idx_state] = elems.mean_anomaly;
+	}
+
+	// the few near-parabolic ones get their mean anomaly redone, out of the vectorized loop
+	for (int idx_state = 0; idx_state < N_states; idx_state++)
+	{
+		if (abs(out.e[idx_state] - 1) < NEAR_PARABOLIC)
+		{
+			out.mean_anomaly[idx_state] = getMeanAnomalyNearParabolic(out.e[idx_state], out.true_anomaly[idx_state]);
+		}
+	}
+}
+
+// single-threaded reference reader, readTycho2Parallel() is what actually gets used (see -bench catalog)
 std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> readTycho2(const std::string& filename = "data/Tycho2.csv")
 {
 	std::ifstream file(filename);
@@ -535,735 +1246,5013 @@ std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> readTy
 	return std::tuple<std::vector<double>, std::vector<double>, std::vector<double>>{ mags, RAs, DECs };
 }
 
-std::vector<State> readStateVectorFile(const std::string& filename)
+// read-only view of a whole file, mapped into memory
+struct MappedFile
 {
-	std::ifstream infile(filename);
-	std::string line;
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	const uint8_t* data = nullptr;
+	uint64_t size = 0;
 
-	std::vector<State> states;
+	bool open(const std::string& filename)
+	{
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
 
-	if (!infile) {
-		std::cerr << "Failed to open file: " << filename << "\n";
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) // empty files can't be mapped
 		{
-			return {};
+			close();
+			return false;
 		}
-	}
+		size = file_size.QuadPart;
 
-	// skip header
-	while (std::getline(infile, line)) {
-		if (line.find('*') != std::string::npos)
-			break;
-	}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			close();
+			return false;
+		}
 
-	while (std::getline(infile, line)) {
-		if (line.find('*') != std::string::npos)
-			break;
+		data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data == nullptr)
+		{
+			close();
+			return false;
+		}
 
-		std::istringstream iss(line);
-		double jd, x, y, z, vx, vy, vz;
-		std::string utc;
+		return true;
+	}
 
-		if (!(iss >> jd >> utc >> x >> y >> z >> vx >> vy >> vz)) {
-			std::cerr << "Skipping bad line:\n" << line << '\n';
-			continue;
+	void close()
+	{
+		if (data)
+		{
+			UnmapViewOfFile(data);
+			data = nullptr;
 		}
+		if (mapping != NULL)
+		{
+			CloseHandle(mapping);
+			mapping = NULL;
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+		size = 0;
+	}
 
-		State new_state;
-		new_state.JD = jd;
-		new_state.datetime = utc;
-		new_state.p = Vec3(x, y, z);
-		new_state.v = Vec3(vx, vy, vz);
+	~MappedFile()
+	{
+		close();
+	}
+};
 
-		states.push_back(new_state);
+// size and last write time of a file, used to tell whether a cache built from it is stale
+bool getFileStamp(const std::string& filename, uint64_t& size, uint64_t& mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attribs;
+	if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attribs))
+	{
+		return false;
 	}
 
-	return states;
+	size = ((uint64_t)attribs.nFileSizeHigh << 32) | attribs.nFileSizeLow;
+	mtime = ((uint64_t)attribs.ftLastWriteTime.dwHighDateTime << 32) | attribs.ftLastWriteTime.dwLowDateTime;
+	return true;
 }
 
-double sexRAToDeg(const std::string& RA_str)
+// a newline-aligned slice of the catalog CSV, parsed by one thread
+struct CatalogChunk
 {
-	int hours, minutes;
-	double seconds;
-	char sep1, sep2;
-	std::istringstream iss(RA_str);
-	iss >> hours >> sep1 >> minutes >> sep2 >> seconds;
+	const char* begin;
+	const char* end;
+	std::vector<double> mags, RAs, DECs;
+	std::string error; // message for the first bad line in the slice, empty if there was none
+};
 
-	if (sep1 != ':' || sep2 != ':') {
-		throw std::runtime_error("Invalid RA format: " + RA_str);
+// same rules as std::stod - leading whitespace and trailing garbage are fine, no number at all is not
+bool parseCatalogCell(const char* begin, const char* end, double& value)
+{
+	while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '\r' || *begin == '\v' || *begin == '\f'))
+	{
+		begin++;
 	}
 
-	return 15.0 * (hours + minutes / 60.0 + seconds / 3600.0);
+	if (begin < end && *begin == '+') // from_chars doesn't take an explicit plus sign
+	{
+		begin++;
+	}
+
+	std::from_chars_result result = std::from_chars(begin, end, value);
+	return result.ec == std::errc();
 }
 
-double sexDECToDeg(const std::string& DEC_str)
+void parseTycho2Chunk(CatalogChunk& chunk)
 {
-	int degrees, arcmin;
-	double arcsec;
-	char sep1, sep2;
-	char sign = DEC_str[0];
-	std::istringstream iss(DEC_str);
-	iss >> degrees >> sep1 >> arcmin >> sep2 >> arcsec;
+	size_t N_lines = std::count(chunk.begin, chunk.end, '\n') + 1;
+	chunk.mags.reserve(N_lines);
+	chunk.RAs.reserve(N_lines);
+	chunk.DECs.reserve(N_lines);
 
-	if (sep1 != ':' || sep2 != ':') {
-		throw std::runtime_error("Invalid DEC format: " + DEC_str);
+	const char* line_begin = chunk.begin;
+	while (line_begin < chunk.end)
+	{
+		const char* line_end = (const char*)memchr(line_begin, '\n', chunk.end - line_begin);
+		if (line_end == nullptr)
+		{
+			line_end = chunk.end;
+		}
+
+		int col_index = 0;
+		double magval = 0, RAval = 0, DECval = 0;
+		bool gotmag = false, gotRA = false, gotDEC = false;
+
+		const char* cell_begin = line_begin;
+		while (cell_begin < line_end && col_index < 5)
+		{
+			const char* cell_end = (const char*)memchr(cell_begin, ',', line_end - cell_begin);
+			if (cell_end == nullptr)
+			{
+				cell_end = line_end;
+			}
+
+			++col_index;
+			bool valid = true;
+			if (col_index == 3)
+			{
+				valid = gotmag = parseCatalogCell(cell_begin, cell_end, magval);
+			}
+			else if (col_index == 4)
+			{
+				valid = gotRA = parseCatalogCell(cell_begin, cell_end, RAval);
+			}
+			else if (col_index == 5)
+			{
+				valid = gotDEC = parseCatalogCell(cell_begin, cell_end, DECval);
+			}
+
+			if (!valid)
+			{
+				chunk.error = "Invalid double value in column " + std::to_string(col_index) + ": " + std::string(cell_begin, cell_end);
+				return;
+			}
+
+			cell_begin = cell_end + 1;
+		}
+
+		if (gotmag && gotRA && gotDEC) {
+			chunk.mags.push_back(magval);
+			chunk.RAs.push_back(RAval);
+			chunk.DECs.push_back(DECval);
+		}
+		else {
+			chunk.error = "Missing expected columns in line: " + std::string(line_begin, line_end);
+			return;
+		}
+
+		line_begin = line_end + 1;
 	}
+}
 
-	double abs_deg = std::abs(degrees) + arcmin / 60.0 + arcsec / 3600.0;
-	return degrees < 0 ? -abs_deg : abs_deg;
+// cuts [begin, end) into N_chunks newline-aligned slices and hands each to parse_chunk along with its index, all of
+// them side by side on their own threads (the first one on the caller's), returns once every slice is parsed
+void parseChunksParallel(const char* begin, const char* end, int N_chunks,
+	const std::function<void(int, const char*, const char*)>& parse_chunk)
+{
+	std::vector<const char*> cuts(N_chunks + 1);
+	cuts[0] = begin;
+	for (int idx_chunk = 0; idx_chunk < N_chunks; idx_chunk++)
+	{
+		const char* chunk_end = end;
+		if (idx_chunk < N_chunks - 1)
+		{
+			chunk_end = begin + (end - begin) * (idx_chunk + 1) / N_chunks;
+			if (chunk_end < cuts[idx_chunk])
+			{
+				chunk_end = cuts[idx_chunk];
+			}
+			// move the cut to just past the next line break
+			const char* newline = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+			chunk_end = newline ? newline + 1 : end;
+		}
+		cuts[idx_chunk + 1] = chunk_end;
+	}
+
+	std::vector<std::thread> workers;
+	for (int idx_chunk = 1; idx_chunk < N_chunks; idx_chunk++)
+	{
+		workers.emplace_back(parse_chunk, idx_chunk, cuts[idx_chunk], cuts[idx_chunk + 1]);
+	}
+	parse_chunk(0, cuts[0], cuts[1]);
+
+	for (int idx_worker = 0; idx_worker < workers.size(); idx_worker++)
+	{
+		workers[idx_worker].join();
+	}
 }
 
-void drawRedCrosshair(std::vector<std::array<int, 3>>& img, int screen_size)
+// splits the file into one newline-aligned chunk per thread, parses them side by side and stitches the results
+// back together in file order
+std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> readTycho2Parallel(const std::string& filename = "data/Tycho2.csv", int N_threads = 0)
 {
-	int cx = screen_size / 2;
-	int cy = screen_size / 2;
-	const std::array<int, 3> red = { 255, 0, 0 };
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		uint64_t size, mtime;
+		if (getFileStamp(filename, size, mtime) && size == 0)
+		{
+			throw std::runtime_error("File is empty or cannot read header!");
+		}
+		throw std::runtime_error("Cannot open star catalog: " + filename);
+	}
 
-	// Draw upward arm
-	for (int dy = -3; dy > -3 - 5; --dy)
+	const char* text = (const char*)file.data;
+	const char* text_end = text + file.size;
+
+	// skip header
+	const char* body = (const char*)memchr(text, '\n', file.size);
+	body = body ? body + 1 : text_end;
+
+	if (N_threads <= 0)
 	{
-		int y = cy + dy;
-		if (y >= 0 && y < screen_size)
-			img[y * screen_size + cx] = red;
+		N_threads = max(1, (int)std::thread::hardware_concurrency());
 	}
 
-	// Draw downward arm
-	for (int dy = 3; dy < 3 + 5; ++dy)
+	std::vector<CatalogChunk> chunks(N_threads);
+	parseChunksParallel(body, text_end, N_threads, [&chunks](int idx_chunk, const char* chunk_begin, const char* chunk_end) {
+		chunks[idx_chunk].begin = chunk_begin;
+		chunks[idx_chunk].end = chunk_end;
+		parseTycho2Chunk(chunks[idx_chunk]);
+	});
+
+	size_t N_stars = 0;
+	for (int idx_chunk = 0; idx_chunk < N_threads; idx_chunk++)
 	{
-		int y = cy + dy;
-		if (y >= 0 && y < screen_size)
-			img[y * screen_size + cx] = red;
+		// report the error that comes first in the file, like the serial reader would
+		if (!chunks[idx_chunk].error.empty())
+		{
+			throw std::runtime_error(chunks[idx_chunk].error);
+		}
+		N_stars += chunks[idx_chunk].mags.size();
 	}
 
-	// Draw left arm
-	for (int dx = -3; dx > -3 - 5; --dx)
+	std::vector<double> mags, RAs, DECs;
+	mags.reserve(N_stars);
+	RAs.reserve(N_stars);
+	DECs.reserve(N_stars);
+
+	for (int idx_chunk = 0; idx_chunk < N_threads; idx_chunk++)
 	{
-		int x = cx + dx;
-		if (x >= 0 && x < screen_size)
-			img[cy * screen_size + x] = red;
+		mags.insert(mags.end(), chunks[idx_chunk].mags.begin(), chunks[idx_chunk].mags.end());
+		RAs.insert(RAs.end(), chunks[idx_chunk].RAs.begin(), chunks[idx_chunk].RAs.end());
+		DECs.insert(DECs.end(), chunks[idx_chunk].DECs.begin(), chunks[idx_chunk].DECs.end());
 	}
 
-	// Draw right arm
-	for (int dx = 3; dx < 3 + 5; ++dx)
+	return std::tuple<std::vector<double>, std::vector<double>, std::vector<double>>{ std::move(mags), std::move(RAs), std::move(DECs) };
+}
+
+// binary star catalog cache
+// layout: StarCatalogHeader, then N_stars magnitudes, N_stars RAs, N_stars DECs (all doubles, one column after another)
+// stars are stored from brightest to faintest so a magnitude limit only needs to read a prefix of each column
+const char STAR_CATALOG_MAGIC[8] = { 'S', 'V', 'I', 'S', 'C', 'A', 'T', '\0' };
+const uint32_t STAR_CATALOG_VERSION = 2;
+
+struct StarCatalogHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t N_stars;
+	uint64_t source_size; // size of the CSV the cache was built from
+	uint64_t source_mtime; // last write time of the CSV the cache was built from
+};
+
+std::string getStarCatalogCachePath(const std::string& filename)
+{
+	return filename + ".bin";
+}
+
+// reorders the catalog columns from brightest to faintest star
+Starfield sortStarsByMagnitude(const std::tuple<std::vector<double>, std::vector<double>, std::vector<double>>& catalog)
+{
+	const std::vector<double>& mags = std::get<0>(catalog);
+	const std::vector<double>& RAs = std::get<1>(catalog);
+	const std::vector<double>& DECs = std::get<2>(catalog);
+
+	std::vector<size_t> order(mags.size());
+	for (size_t idx_star = 0; idx_star < order.size(); idx_star++)
 	{
-		int x = cx + dx;
-		if (x >= 0 && x < screen_size)
-			img[cy * screen_size + x] = red;
+		order[idx_star] = idx_star;
+	}
+	std::stable_sort(order.begin(), order.end(), [&mags](size_t a, size_t b) { return mags[a] < mags[b]; });
+
+	Starfield starfield;
+	starfield.mags.resize(order.size());
+	starfield.RAs.resize(order.size());
+	starfield.DECs.resize(order.size());
+
+	for (size_t idx_star = 0; idx_star < order.size(); idx_star++)
+	{
+		starfield.mags[idx_star] = mags[order[idx_star]];
+		starfield.RAs[idx_star] = RAs[order[idx_star]];
+		starfield.DECs[idx_star] = DECs[order[idx_star]];
 	}
+
+	return starfield;
 }
 
-void drawChar(std::vector<std::array<int, 3>>& img, int screen_x, int screen_y,
-	int x0, int y0, const uint8_t bitmap[8], std::array<int, 3> color)
+// drops everything fainter than mag_limit (the starfield must already be sorted)
+void truncateStarfield(Starfield& starfield, double mag_limit)
 {
-	for (int row = 0; row < 8; ++row)
+	size_t N_visible = std::upper_bound(starfield.mags.begin(), starfield.mags.end(), mag_limit) - starfield.mags.begin();
+
+	// copy rather than resize so the faint tail's memory is actually given back
+	starfield.mags = std::vector<double>(starfield.mags.begin(), starfield.mags.begin() + N_visible);
+	starfield.RAs = std::vector<double>(starfield.RAs.begin(), starfield.RAs.begin() + N_visible);
+	starfield.DECs = std::vector<double>(starfield.DECs.begin(), starfield.DECs.begin() + N_visible);
+	starfield.mag_limit = mag_limit;
+}
+
+bool writeStarCatalogCache(const std::string& filename, const Starfield& starfield,
+	uint64_t source_size, uint64_t source_mtime)
+{
+	StarCatalogHeader header = {};
+	memcpy(header.magic, STAR_CATALOG_MAGIC, sizeof(header.magic));
+	header.version = STAR_CATALOG_VERSION;
+	header.header_size = sizeof(StarCatalogHeader);
+	header.N_stars = starfield.mags.size();
+	header.source_size = source_size;
+	header.source_mtime = source_mtime;
+
+	std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
+	if (!outfile.is_open())
 	{
-		for (int col = 0; col < 8; ++col)
+		return false;
+	}
+
+	outfile.write((const char*)&header, sizeof(header));
+	outfile.write((const char*)starfield.mags.data(), starfield.mags.size() * sizeof(double));
+	outfile.write((const char*)starfield.RAs.data(), starfield.RAs.size() * sizeof(double));
+	outfile.write((const char*)starfield.DECs.data(), starfield.DECs.size() * sizeof(double));
+	outfile.close();
+
+	if (!outfile)
+	{
+		DeleteFileA(filename.c_str()); // don't leave a truncated cache behind
+		return false;
+	}
+
+	return true;
+}
+
+// returns false if the cache is missing, corrupt, of another version or older than its source CSV
+// only the stars up to mag_limit are copied out, the pages holding the faint tail are never touched
+bool readStarCatalogCache(const std::string& filename, bool check_source, uint64_t source_size, uint64_t source_mtime,
+	double mag_limit, Starfield& starfield)
+{
+	MappedFile cache;
+	if (!cache.open(filename) || cache.size < sizeof(StarCatalogHeader))
+	{
+		return false;
+	}
+
+	StarCatalogHeader header;
+	memcpy(&header, cache.data, sizeof(header));
+
+	if (memcmp(header.magic, STAR_CATALOG_MAGIC, sizeof(header.magic)) || header.version != STAR_CATALOG_VERSION
+		|| header.header_size != sizeof(StarCatalogHeader)
+		|| cache.size != header.header_size + 3 * header.N_stars * sizeof(double))
+	{
+		return false;
+	}
+
+	if (check_source && (header.source_size != source_size || header.source_mtime != source_mtime))
+	{
+		return false;
+	}
+
+	const double* mags = (const double*)(cache.data + header.header_size);
+	const double* RAs = mags + header.N_stars;
+	const double* DECs = RAs + header.N_stars;
+
+	size_t N_visible = std::upper_bound(mags, mags + header.N_stars, mag_limit) - mags;
+
+	starfield.mags.assign(mags, mags + N_visible);
+	starfield.RAs.assign(RAs, RAs + N_visible);
+	starfield.DECs.assign(DECs, DECs + N_visible);
+	starfield.mag_limit = mag_limit;
+
+	return true;
+}
+
+// HEALPix resolution of the sky tiles, 12 * 16^2 = 3072 equal-area tiles of about 3.7 deg across
+const int SKY_TILE_NSIDE = 16;
+
+// HEALPix RING scheme pixel index for a direction given as z = sin(DEC), phi = RA (rad)
+int healpixRingIndex(int nside, double z, double phi)
+{
+	double za = std::abs(z);
+	double tt = fmod(phi, 2 * PI);
+	if (tt < 0)
+	{
+		tt += 2 * PI;
+	}
+	tt = tt / (PI / 2); // in [0, 4)
+
+	int idx;
+	if (za <= 2.0 / 3.0) // equatorial belt
+	{
+		double temp1 = nside * (0.5 + tt);
+		double temp2 = nside * z * 0.75;
+		int jp = (int)(temp1 - temp2); // ascending edge line
+		int jm = (int)(temp1 + temp2); // descending edge line
+		int ir = nside + 1 + jp - jm; // ring number counted from z = 2/3, in [1, 2 * nside + 1]
+		int kshift = 1 - (ir & 1);
+		int ip = (jp + jm - nside + kshift + 1) / 2;
+		ip = ((ip % (4 * nside)) + 4 * nside) % (4 * nside);
+		idx = 2 * nside * (nside - 1) + (ir - 1) * 4 * nside + ip;
+	}
+	else // polar caps
+	{
+		double tp = tt - (int)tt;
+		double tmp = nside * sqrt(3 * (1 - za));
+		int jp = (int)(tp * tmp);
+		int jm = (int)((1.0 - tp) * tmp);
+		int ir = jp + jm + 1; // ring number counted from the closest pole
+		int ip = (int)(tt * ir);
+		ip = ((ip % (4 * ir)) + 4 * ir) % (4 * ir);
+
+		if (z > 0)
 		{
-			if (bitmap[row] & (1 << col)) // LSB-left: leftmost pixel = bit 0
+			idx = 2 * ir * (ir - 1) + ip;
+		}
+		else
+		{
+			idx = 12 * nside * nside - 2 * ir * (ir + 1) + ip;
+		}
+	}
+
+	return min(max(idx, 0), 12 * nside * nside - 1);
+}
+
+// turns RA/DEC into ecliptic unit vectors once, so no view has to redo the trig and the frame rotation
+void computeStarDirections(Starfield& starfield)
+{
+	starfield.dirs.resize(starfield.mags.size());
+
+	for (size_t idx_star = 0; idx_star < starfield.mags.size(); idx_star++)
+	{
+		Vec3 star_pos_equ = Vec3(starfield.RAs[idx_star], starfield.DECs[idx_star]);
+
+		SpiceDouble star_pos_equ_dbl[3] = { star_pos_equ.x, star_pos_equ.y, star_pos_equ.z };
+		SpiceDouble star_pos_ecl_dbl[3];
+		mxv_c(equ_ecl_rot, star_pos_equ_dbl, star_pos_ecl_dbl);
+
+		starfield.dirs[idx_star] = Vec3(star_pos_ecl_dbl[0], star_pos_ecl_dbl[1], star_pos_ecl_dbl[2]);
+	}
+
+	starfield.RAs = std::vector<double>();
+	starfield.DECs = std::vector<double>();
+}
+
+// buckets the stars into HEALPix tiles (in ecliptic coordinates), reordering the columns so each tile's stars
+// are contiguous (a stable sort, so every tile is still ordered brightest first)
+void buildSkyTiles(Starfield& starfield, int nside = SKY_TILE_NSIDE)
+{
+	int N_pix = 12 * nside * nside;
+	size_t N_stars = starfield.mags.size();
+
+	std::vector<int> star_pix(N_stars);
+	std::vector<int> pix_counts(N_pix + 1, 0);
+	for (size_t idx_star = 0; idx_star < N_stars; idx_star++)
+	{
+		const Vec3& dir = starfield.dirs[idx_star];
+		star_pix[idx_star] = healpixRingIndex(nside, dir.z, atan2(dir.y, dir.x));
+		pix_counts[star_pix[idx_star] + 1]++;
+	}
+
+	// counting sort by pixel
+	for (int idx_pix = 0; idx_pix < N_pix; idx_pix++)
+	{
+		pix_counts[idx_pix + 1] += pix_counts[idx_pix];
+	}
+
+	std::vector<double> mags(N_stars);
+	std::vector<Vec3> dirs(N_stars);
+	std::vector<int> next_slot(pix_counts.begin(), pix_counts.end() - 1);
+	for (size_t idx_star = 0; idx_star < N_stars; idx_star++)
+	{
+		int slot = next_slot[star_pix[idx_star]]++;
+		mags[slot] = starfield.mags[idx_star];
+		dirs[slot] = starfield.dirs[idx_star];
+	}
+
+	starfield.mags.swap(mags);
+	starfield.dirs.swap(dirs);
+
+	starfield.tiles.clear();
+	for (int idx_pix = 0; idx_pix < N_pix; idx_pix++)
+	{
+		int first_star = pix_counts[idx_pix];
+		int N_tile_stars = pix_counts[idx_pix + 1] - first_star;
+		if (N_tile_stars == 0)
+		{
+			continue;
+		}
+
+		// bounding cone: mean direction of the tile's stars and the widest angle from it
+		Vec3 center;
+		for (int idx_star = first_star; idx_star < first_star + N_tile_stars; idx_star++)
+		{
+			center += starfield.dirs[idx_star];
+		}
+		center = center.normalized();
+
+		double cos_radius = 1;
+		for (int idx_star = first_star; idx_star < first_star + N_tile_stars; idx_star++)
+		{
+			cos_radius = min(cos_radius, center.dot(starfield.dirs[idx_star]));
+		}
+
+		SkyTile tile;
+		tile.center = center;
+		tile.sin_radius = cos_radius > 0 ? sqrt(max(0.0, 1 - cos_radius * cos_radius)) + 1e-9 : 1; // a tile can't be wider than a hemisphere anyway
+		tile.first_star = first_star;
+		tile.N_stars = N_tile_stars;
+		starfield.tiles.push_back(tile);
+	}
+}
+
+// indices of the sky tiles that may have stars inside the camera's view
+// the camera axes have to be in the same frame as the tiles (J2000 ecliptic)
+std::vector<int> getVisibleSkyTiles(const Starfield& starfield, Vec3 cam_right, Vec3 cam_up, Vec3 cam_forward,
+	double f, int screen_x, int screen_y)
+{
+	// stars are at infinity, so the frustum is just four planes through the origin (plus the forward hemisphere)
+	// the extra pixels cover star dots drawn partly over the edge
+	double tan_x = (screen_x / 2 + 2) / f;
+	double tan_y = (screen_y / 2 + 2) / f;
+
+	Vec3 planes[5] = {
+		cam_forward,
+		(cam_forward * tan_x - cam_right).normalized(),
+		(cam_forward * tan_x + cam_right).normalized(),
+		(cam_forward * tan_y - cam_up).normalized(),
+		(cam_forward * tan_y + cam_up).normalized()
+	};
+
+	std::vector<int> visible_tiles;
+	for (int idx_tile = 0; idx_tile < starfield.tiles.size(); idx_tile++)
+	{
+		const SkyTile& tile = starfield.tiles[idx_tile];
+
+		bool outside = false;
+		for (int idx_plane = 0; idx_plane < 5; idx_plane++)
+		{
+			if (tile.center.dot(planes[idx_plane]) < -tile.sin_radius) // whole cone is behind this plane
 			{
-				int x = x0 + col;
-				int y = y0 + row;
-				if (x >= 0 && x < screen_x && y >= 0 && y < screen_y)
-				{
-					img[y * screen_x + x] = color;
-				}
+				outside = true;
+				break;
 			}
 		}
+
+		if (!outside)
+		{
+			visible_tiles.push_back(idx_tile);
+		}
 	}
+
+	return visible_tiles;
 }
 
-void drawText(std::vector<std::array<int, 3>>& img, int screen_x, int screen_y,
-	int x, int y, const std::string& text, std::array<int, 3> color)
+// loads the star catalog (brightest first, nothing fainter than mag_limit) from its binary cache, falls back to
+// parsing the CSV (and rebuilding the cache) when the cache is missing or stale
+// needs equ_ecl_rot, so the SPICE kernels have to be loaded first
+Starfield loadStarCatalog(const std::string& filename = "data/Tycho2.csv", double mag_limit = 6)
 {
-	for (char c : text)
+	std::string cache_filename = getStarCatalogCachePath(filename);
+
+	uint64_t source_size = 0, source_mtime = 0;
+	bool has_source = getFileStamp(filename, source_size, source_mtime);
+
+	Starfield starfield;
+
+	// without the CSV around there is nothing to compare against, so any valid cache will do
+	if (readStarCatalogCache(cache_filename, has_source, source_size, source_mtime, mag_limit, starfield))
+	{
+		computeStarDirections(starfield);
+		buildSkyTiles(starfield);
+		return starfield;
+	}
+
+	// the cache keeps the whole catalog so a different limit later on doesn't need a rebuild
+	starfield = sortStarsByMagnitude(readTycho2Parallel(filename));
+
+	if (!writeStarCatalogCache(cache_filename, starfield, source_size, source_mtime))
+	{
+		std::cerr << "Could not write star catalog cache: " << cache_filename << '\n';
+	}
+
+	truncateStarfield(starfield, mag_limit);
+	computeStarDirections(starfield);
+	buildSkyTiles(starfield);
+
+	return starfield;
+}
+
+// minor planets drawn as single points behind the target object, the main belt and NEOs from an MPCORB-style file
+// kept in the form the propagator wants, two-body orbits around the Sun with
+// position = (cos(E) - e) * P + sin(E) * Q, E - e sin(E) = M_ref + n * ET
+struct Population
+{
+	std::vector<double> Px, Py, Pz; // km, periapsis direction scaled by a
+	std::vector<double> Qx, Qy, Qz; // km, 90 degrees ahead of it scaled by b = a sqrt(1 - e^2)
+	std::vector<double> e;
+	std::vector<double> n; // rad/s, mean motion
+	std::vector<double> M_ref; // rad, mean anomaly at ET 0 (J2000 TDB)
+
+	size_t size() const
+	{
+		return e.size();
+	}
+
+	// elements in the J2000 ecliptic, angles in degrees, like the orbit reference code takes them
+	void addElements(double a, double ecc, double i, double node, double arg_periapsis, double M, double n_deg_day, double epoch_et)
+	{
+		double cos_o = cos(deg2rad(node));
+		double sin_o = sin(deg2rad(node));
+		double cos_i = cos(deg2rad(i));
+		double sin_i = sin(deg2rad(i));
+		double cos_w = cos(deg2rad(arg_periapsis));
+		double sin_w = sin(deg2rad(arg_periapsis));
+		double b = a * sqrt(1 - ecc * ecc);
+
+		// the columns of the rotation in getKeplerOrbitPointsReference()
+		Px.push_back(a * (cos_o * cos_w - sin_o * cos_i * sin_w));
+		Py.push_back(a * (sin_o * cos_w + cos_o * cos_i * sin_w));
+		Pz.push_back(a * (sin_i * sin_w));
+		Qx.push_back(b * (-cos_o * sin_w - sin_o * cos_i * cos_w));
+		Qy.push_back(b * (-sin_o * sin_w + cos_o * cos_i * cos_w));
+		Qz.push_back(b * (sin_i * cos_w));
+		e.push_back(ecc);
+
+		double n_rad = deg2rad(n_deg_day) / 86400;
+		n.push_back(n_rad);
+		M_ref.push_back(fmod(deg2rad(M) - n_rad * epoch_et, 2 * PI));
+	}
+
+	void append(const Population& other)
+	{
+		Px.insert(Px.end(), other.Px.begin(), other.Px.end());
+		Py.insert(Py.end(), other.Py.begin(), other.Py.end());
+		Pz.insert(Pz.end(), other.Pz.begin(), other.Pz.end());
+		Qx.insert(Qx.end(), other.Qx.begin(), other.Qx.end());
+		Qy.insert(Qy.end(), other.Qy.begin(), other.Qy.end());
+		Qz.insert(Qz.end(), other.Qz.begin(), other.Qz.end());
+		e.insert(e.end(), other.e.begin(), other.e.end());
+		n.insert(n.end(), other.n.begin(), other.n.end());
+		M_ref.insert(M_ref.end(), other.M_ref.begin(), other.M_ref.end());
+	}
+};
+
+// one character of a packed MPC date: 1-9, then A = 10 up to V = 31
+int unpackMPCDigit(char c)
+{
+	if (c >= '1' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'V')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// packed MPC epoch (K2555 is 2025 May 5) at 0h TT, which is ET to within 2 ms
+bool unpackMPCEpoch(const char* packed, double& et)
+{
+	int century = packed[0] == 'I' ? 18 : (packed[0] == 'J' ? 19 : (packed[0] == 'K' ? 20 : -1));
+	if (century < 0 || packed[1] < '0' || packed[1] > '9' || packed[2] < '0' || packed[2] > '9')
+	{
+		return false;
+	}
+
+	int year = century * 100 + (packed[1] - '0') * 10 + (packed[2] - '0');
+	int month = unpackMPCDigit(packed[3]);
+	int day = unpackMPCDigit(packed[4]);
+	if (month < 1 || month > 12 || day < 1)
+	{
+		return false;
+	}
+
+	// Julian day number of the Gregorian date, the day itself starts half a day earlier
+	int a = (14 - month) / 12;
+	long long y = year + 4800 - a;
+	long long m = month + 12 * a - 3;
+	long long jdn = day + (153 * m + 2) / 5 + 365 * y + y / 4 - y / 100 + y / 400 - 32045;
+
+	et = (jdn - 0.5 - 2451545.0) * 86400;
+	return true;
+}
+
+// a newline-aligned slice of the population file, parsed by one thread
+struct PopulationChunk
+{
+	const char* begin;
+	const char* end;
+	Population objects;
+	size_t N_skipped = 0; // header, blank and unparsable lines, and open orbits
+};
+
+// MPCORB columns: epoch 21-25, M 27-35, peri. 38-46, node 49-57, incl. 60-68, e 71-79, n 81-91, a 93-103
+// anything else on the line is ignored, and so is every line that doesn't have all of them (the header, mostly)
+void parsePopulationChunk(PopulationChunk& chunk)
+{
+	const int col_begin[7] = { 26, 37, 48, 59, 70, 80, 92 };
+	const int col_end[7] = { 35, 46, 57, 68, 79, 91, 103 };
+
+	const char* line_begin = chunk.begin;
+	while (line_begin < chunk.end)
+	{
+		const char* line_end = (const char*)memchr(line_begin, '\n', chunk.end - line_begin);
+		if (line_end == nullptr)
+		{
+			line_end = chunk.end;
+		}
+
+		double values[7]; // M, peri., node, incl., e, n, a
+		double epoch_et;
+		bool valid = line_end - line_begin >= 103 && unpackMPCEpoch(line_begin + 20, epoch_et);
+		for (int idx_col = 0; valid && idx_col < 7; idx_col++)
+		{
+			valid = parseCatalogCell(line_begin + col_begin[idx_col], line_begin + col_end[idx_col], values[idx_col]);
+		}
+
+		if (valid && values[4] >= 0 && values[4] < 1 && values[6] > 0)
+		{
+			chunk.objects.addElements(values[6] * AU, values[4], values[3], values[2], values[1], values[0], values[5], epoch_et);
+		}
+		else
+		{
+			chunk.N_skipped++;
+		}
+
+		line_begin = line_end + 1;
+	}
+}
+
+// one newline-aligned chunk per thread, see parseChunksParallel()
+Population readMPCORBParallel(const std::string& filename, size_t& N_skipped, int N_threads = 0)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		throw std::runtime_error("Cannot open population file: " + filename);
+	}
+
+	const char* text = (const char*)file.data;
+	const char* text_end = text + file.size;
+
+	if (N_threads <= 0)
+	{
+		N_threads = max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	std::vector<PopulationChunk> chunks(N_threads);
+	parseChunksParallel(text, text_end, N_threads, [&chunks](int idx_chunk, const char* chunk_begin, const char* chunk_end) {
+		chunks[idx_chunk].begin = chunk_begin;
+		chunks[idx_chunk].end = chunk_end;
+		parsePopulationChunk(chunks[idx_chunk]);
+	});
+
+	Population population;
+	N_skipped = 0;
+	for (int idx_chunk = 0; idx_chunk < N_threads; idx_chunk++)
+	{
+		population.append(chunks[idx_chunk].objects);
+		N_skipped += chunks[idx_chunk].N_skipped;
+	}
+
+	return population;
+}
+
+// binary population cache, same idea as the star catalog's
+// layout: PopulationHeader, then the nine columns of Population one after another (all doubles)
+const char POPULATION_MAGIC[8] = { 'S', 'V', 'I', 'S', 'P', 'O', 'P', '\0' };
+const uint32_t POPULATION_VERSION = 1;
+
+struct PopulationHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t N_objects;
+	uint64_t source_size; // size of the element file the cache was built from
+	uint64_t source_mtime; // last write time of the element file the cache was built from
+};
+
+std::string getPopulationCachePath(const std::string& filename)
+{
+	return filename + ".bin";
+}
+
+bool writePopulationCache(const std::string& filename, const Population& population, uint64_t source_size, uint64_t source_mtime)
+{
+	PopulationHeader header = {};
+	memcpy(header.magic, POPULATION_MAGIC, sizeof(header.magic));
+	header.version = POPULATION_VERSION;
+	header.header_size = sizeof(PopulationHeader);
+	header.N_objects = population.size();
+	header.source_size = source_size;
+	header.source_mtime = source_mtime;
+
+	std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
+	if (!outfile.is_open())
+	{
+		return false;
+	}
+
+	const std::vector<double>* columns[9] = { &population.Px, &population.Py, &population.Pz, &population.Qx, &population.Qy,
+		&population.Qz, &population.e, &population.n, &population.M_ref };
+
+	outfile.write((const char*)&header, sizeof(header));
+	for (int idx_col = 0; idx_col < 9; idx_col++)
+	{
+		outfile.write((const char*)columns[idx_col]->data(), columns[idx_col]->size() * sizeof(double));
+	}
+	outfile.close();
+
+	if (!outfile)
+	{
+		DeleteFileA(filename.c_str()); // don't leave a truncated cache behind
+		return false;
+	}
+
+	return true;
+}
+
+// returns false if the cache is missing, corrupt, of another version or older than its source file
+bool readPopulationCache(const std::string& filename, bool check_source, uint64_t source_size, uint64_t source_mtime,
+	Population& population)
+{
+	MappedFile cache;
+	if (!cache.open(filename) || cache.size < sizeof(PopulationHeader))
+	{
+		return false;
+	}
+
+	PopulationHeader header;
+	memcpy(&header, cache.data, sizeof(header));
+
+	if (memcmp(header.magic, POPULATION_MAGIC, sizeof(header.magic)) || header.version != POPULATION_VERSION
+		|| header.header_size != sizeof(PopulationHeader)
+		|| cache.size != header.header_size + 9 * header.N_objects * sizeof(double))
+	{
+		return false;
+	}
+
+	if (check_source && (header.source_size != source_size || header.source_mtime != source_mtime))
+	{
+		return false;
+	}
+
+	std::vector<double>* columns[9] = { &population.Px, &population.Py, &population.Pz, &population.Qx, &population.Qy,
+		&population.Qz, &population.e, &population.n, &population.M_ref };
+
+	const double* column = (const double*)(cache.data + header.header_size);
+	for (int idx_col = 0; idx_col < 9; idx_col++)
+	{
+		columns[idx_col]->assign(column, column + header.N_objects);
+		column += header.N_objects;
+	}
+
+	return true;
+}
+
+// loads the population from its binary cache, or parses the element file (and writes the cache) when the cache is
+// missing or stale
+Population loadPopulation(const std::string& filename)
+{
+	std::string cache_filename = getPopulationCachePath(filename);
+
+	uint64_t source_size = 0, source_mtime = 0;
+	bool has_source = getFileStamp(filename, source_size, source_mtime);
+
+	Population population;
+	if (readPopulationCache(cache_filename, has_source, source_size, source_mtime, population))
+	{
+		return population;
+	}
+
+	size_t N_skipped;
+	population = readMPCORBParallel(filename, N_skipped);
+	std::cout << "(" << population.size() << " orbits read, " << N_skipped << " lines skipped) ";
+
+	if (!writePopulationCache(cache_filename, population, source_size, source_mtime))
+	{
+		std::cerr << "Could not write population cache: " << cache_filename << '\n';
+	}
+
+	return population;
+}
+
+// UTC Julian date -> ET without going through the UTC string parser, using the leap second table of the loaded LSK
+// same model as SPICE's deltet_c: ET - UTC = delta_T_A + delta_AT + K sin(E), E = M + EB sin(M), M = M0 + M1 * t
+struct LeapSecondTable
+{
+	std::vector<double> delta_at; // TAI - UTC (s)
+	std::vector<double> epochs; // UTC seconds past J2000 from which each delta_at applies
+	double delta_t_a, K, EB, M0, M1;
+
+	// reads the DELTET/ variables from the kernel pool, returns false if no leap second kernel is loaded
+	bool load()
+	{
+		SpiceInt N_values;
+		SpiceBoolean found;
+
+		SpiceDouble values[2 * 200];
+		gdpool_c("DELTET/DELTA_AT", 0, 2 * 200, &N_values, values, &found);
+		if (!found || N_values < 2)
+		{
+			return false;
+		}
+
+		delta_at.clear();
+		epochs.clear();
+		for (int idx_value = 0; idx_value + 1 < N_values; idx_value += 2)
+		{
+			delta_at.push_back(values[idx_value]);
+			epochs.push_back(values[idx_value + 1]);
+		}
+
+		SpiceBoolean found_t_a, found_K, found_EB, found_M;
+		SpiceDouble M[2];
+		gdpool_c("DELTET/DELTA_T_A", 0, 1, &N_values, &delta_t_a, &found_t_a);
+		gdpool_c("DELTET/K", 0, 1, &N_values, &K, &found_K);
+		gdpool_c("DELTET/EB", 0, 1, &N_values, &EB, &found_EB);
+		gdpool_c("DELTET/M", 0, 2, &N_values, M, &found_M);
+
+		if (!found_t_a || !found_K || !found_EB || !found_M || N_values < 2)
+		{
+			return false;
+		}
+
+		M0 = M[0];
+		M1 = M[1];
+
+		return true;
+	}
+
+	double jd2et(double jd) const
+	{
+		double utc = (jd - 2451545.0) * 86400;
+
+		// the last leap second entry at or before this epoch (before the first entry the first value applies)
+		size_t idx_leap = std::upper_bound(epochs.begin(), epochs.end(), utc) - epochs.begin();
+		double dat = delta_at[idx_leap > 0 ? idx_leap - 1 : 0];
+
+		double aet = utc + dat + delta_t_a;
+		double M = M0 + M1 * aet;
+		double E = M + EB * sin(M);
+
+		return utc + delta_t_a + dat + K * sin(E);
+	}
+};
+
+// reads a state vector file on its own thread and hands the states over through a bounded queue, so mapping can
+// start on the first state while the rest of the file is still being parsed, and memory doesn't grow with the file
+// ET is taken from the UTC string with utc2et_c, or from the JD column if a leap second table is given
+class StateVectorStream
+{
+public:
+	double parse_time = 0; // s spent by the reader thread, valid once next() has returned false
+
+	StateVectorStream(const std::string& filename, const LeapSecondTable* leap_seconds_p = nullptr, size_t capacity_p = 256)
+	{
+		leap_seconds = leap_seconds_p;
+		capacity = capacity_p;
+		reader = std::thread(&StateVectorStream::readerLoop, this, filename);
+	}
+
+	~StateVectorStream()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			cancelled = true;
+		}
+		not_full.notify_all();
+		reader.join();
+	}
+
+	// blocks until the next state is parsed, returns false once the file is exhausted
+	bool next(State& st)
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		not_empty.wait(lock, [this] { return !queue.empty() || finished; });
+
+		if (queue.empty())
+		{
+			return false;
+		}
+
+		st = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		not_full.notify_one();
+
+		return true;
+	}
+
+private:
+	const LeapSecondTable* leap_seconds;
+	size_t capacity;
+	std::thread reader;
+
+	std::mutex queue_mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::deque<State> queue;
+	bool finished = false;
+	bool cancelled = false;
+
+	void readerLoop(std::string filename)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		readFile(filename);
+
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			parse_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			finished = true;
+		}
+		not_empty.notify_all();
+	}
+
+	void readFile(const std::string& filename)
+	{
+		std::ifstream infile(filename);
+		std::string line;
+
+		if (!infile) {
+			std::cerr << "Failed to open file: " << filename << "\n";
+			return;
+		}
+
+		// skip header
+		while (std::getline(infile, line)) {
+			if (line.find('*') != std::string::npos)
+				break;
+		}
+
+		while (std::getline(infile, line)) {
+			if (line.find('*') != std::string::npos)
+				break;
+
+			std::istringstream iss(line);
+			double jd, x, y, z, vx, vy, vz;
+			std::string utc;
+
+			if (!(iss >> jd >> utc >> x >> y >> z >> vx >> vy >> vz)) {
+				std::cerr << "Skipping bad line:\n" << line << '\n';
+				continue;
+			}
+
+			State new_state;
+			new_state.JD = jd;
+			new_state.datetime = utc;
+
+			if (leap_seconds)
+			{
+				new_state.et = leap_seconds->jd2et(jd);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> spice_lock(spice_mutex);
+				utc2et_c(utc.c_str(), &new_state.et);
+			}
+
+			new_state.p = Vec3(x, y, z);
+			new_state.v = Vec3(vx, vy, vz);
+
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			not_full.wait(lock, [this] { return queue.size() < capacity || cancelled; });
+			if (cancelled)
+			{
+				return;
+			}
+
+			queue.push_back(std::move(new_state));
+			lock.unlock();
+			not_empty.notify_one();
+		}
+	}
+};
+
+double sexRAToDeg(const std::string& RA_str)
+{
+	int hours, minutes;
+	double seconds;
+	char sep1, sep2;
+	std::istringstream iss(RA_str);
+	iss >> hours >> sep1 >> minutes >> sep2 >> seconds;
+
+	if (sep1 != ':' || sep2 != ':') {
+		throw std::runtime_error("Invalid RA format: " + RA_str);
+	}
+
+	return 15.0 * (hours + minutes / 60.0 + seconds / 3600.0);
+}
+
+double sexDECToDeg(const std::string& DEC_str)
+{
+	int degrees, arcmin;
+	double arcsec;
+	char sep1, sep2;
+	char sign = DEC_str[0];
+	std::istringstream iss(DEC_str);
+	iss >> degrees >> sep1 >> arcmin >> sep2 >> arcsec;
+
+	if (sep1 != ':' || sep2 != ':') {
+		throw std::runtime_error("Invalid DEC format: " + DEC_str);
+	}
+
+	double abs_deg = std::abs(degrees) + arcmin / 60.0 + arcsec / 3600.0;
+	return degrees < 0 ? -abs_deg : abs_deg;
+}
+
+// fill count pixels with one color, 16 bytes per store once the pointer is aligned
+void fillPixels(uint32_t* dst, size_t count, uint32_t color)
+{
+	size_t idx = 0;
+	while (idx < count && ((uintptr_t)(dst + idx) & 15))
+	{
+		dst[idx++] = color;
+	}
+
+	__m128i packed = _mm_set1_epi32((int)color);
+	for (; idx + 4 <= count; idx += 4)
+	{
+		_mm_store_si128((__m128i*)(dst + idx), packed);
+	}
+
+	for (; idx < count; idx++)
+	{
+		dst[idx] = color;
+	}
+}
+
+// the render target: packed RGBA pixels, rows padded to a multiple of 16 bytes
+// resize() keeps the old allocation when it is big enough, so a framebuffer can be reused for every view
+class Framebuffer
+{
+public:
+	int width = 0;
+	int height = 0;
+	int stride = 0; // pixels per row, padding included
+
+	void resize(int new_width, int new_height)
+	{
+		width = new_width;
+		height = new_height;
+		stride = (new_width + 3) & ~3;
+		pixels.resize((size_t)stride * new_height);
+	}
+
+	uint32_t* row(int y)
+	{
+		return pixels.data() + (size_t)y * stride;
+	}
+
+	const uint32_t* row(int y) const
+	{
+		return pixels.data() + (size_t)y * stride;
+	}
+
+	bool contains(int x, int y) const
+	{
+		return x >= 0 && x < width && y >= 0 && y < height;
+	}
+
+	// no bounds check, the caller clips
+	void setPixel(int x, int y, uint32_t color)
+	{
+		row(y)[x] = color;
+	}
+
+	uint32_t getPixel(int x, int y) const
+	{
+		return row(y)[x];
+	}
+
+	// fills [x0, x1) on row y, clipped to the image
+	void fillSpan(int y, int x0, int x1, uint32_t color)
+	{
+		if (y < 0 || y >= height)
+		{
+			return;
+		}
+
+		x0 = max(x0, 0);
+		x1 = min(x1, width);
+		if (x0 < x1)
+		{
+			fillPixels(row(y) + x0, x1 - x0, color);
+		}
+	}
+
+	void clear(uint32_t color)
+	{
+		fillPixels(pixels.data(), pixels.size(), color);
+	}
+
+private:
+	std::vector<uint32_t> pixels;
+};
+
+void drawRedCrosshair(Framebuffer& img, int screen_size)
+{
+	int cx = screen_size / 2;
+	int cy = screen_size / 2;
+	const uint32_t red = packRGB(255, 0, 0);
+
+	// Draw upward arm
+	for (int dy = -3; dy > -3 - 5; --dy)
+	{
+		int y = cy + dy;
+		if (y >= 0 && y < screen_size)
+			img.setPixel(cx, y, red);
+	}
+
+	// Draw downward arm
+	for (int dy = 3; dy < 3 + 5; ++dy)
+	{
+		int y = cy + dy;
+		if (y >= 0 && y < screen_size)
+			img.setPixel(cx, y, red);
+	}
+
+	// Draw left arm
+	for (int dx = -3; dx > -3 - 5; --dx)
+	{
+		int x = cx + dx;
+		if (x >= 0 && x < screen_size)
+			img.setPixel(x, cy, red);
+	}
+
+	// Draw right arm
+	for (int dx = 3; dx < 3 + 5; ++dx)
+	{
+		int x = cx + dx;
+		if (x >= 0 && x < screen_size)
+			img.setPixel(x, cy, red);
+	}
+}
+
+// the part of the image a draw call may touch, [x0, x1) x [y0, y1), always inside the image
+struct ClipRect
+{
+	int x0, y0, x1, y1;
+
+	bool contains(int x, int y) const
+	{
+		return x >= x0 && x < x1 && y >= y0 && y < y1;
+	}
+};
+
+ClipRect getFullClipRect(const Framebuffer& img)
+{
+	return ClipRect{ 0, 0, img.width, img.height };
+}
+
+void drawChar(Framebuffer& img, const ClipRect& clip, int x0, int y0, const uint8_t bitmap[8], uint32_t color)
+{
+	for (int row = 0; row < 8; ++row)
+	{
+		for (int col = 0; col < 8; ++col)
+		{
+			if (bitmap[row] & (1 << col)) // LSB-left: leftmost pixel = bit 0
+			{
+				int x = x0 + col;
+				int y = y0 + row;
+				if (clip.contains(x, y))
+				{
+					img.setPixel(x, y, color);
+				}
+			}
+		}
+	}
+}
+
+void drawText(Framebuffer& img, const ClipRect& clip, int x, int y, const std::string& text, uint32_t color)
+{
+	for (char c : text)
+	{
+		const uint8_t* bitmap = font8x8_basic[(unsigned char)c]; // assuming it's defined
+		drawChar(img, clip, x, y, bitmap, color);
+		x += 8; // fixed spacing
+	}
+}
+
+// half-width of row dy of a disc, floor(sqrt(r^2 - dy^2)), i.e. the pixels with dx^2 + dy^2 <= r^2
+long long getDiscHalfWidth(long long radius, long long dy)
+{
+	long long rem = radius * radius - dy * dy;
+	long long half_width = (long long)sqrt((double)rem);
+
+	// the double sqrt can be one off for big radii
+	while (half_width * half_width > rem)
+	{
+		half_width--;
+	}
+	while ((half_width + 1) * (half_width + 1) <= rem)
+	{
+		half_width++;
+	}
+	return half_width;
+}
+
+const int DISC_SPRITE_MAX_RADIUS = 8; // stars are 1 px, planets 3 px, the Sun 5 px
+
+// prebaked row half-widths for the small discs, row dy of radius r is at half_widths[r][dy + r]
+struct DiscSprites
+{
+	int half_widths[DISC_SPRITE_MAX_RADIUS + 1][2 * DISC_SPRITE_MAX_RADIUS + 1];
+
+	DiscSprites()
+	{
+		for (int radius = 0; radius <= DISC_SPRITE_MAX_RADIUS; radius++)
+		{
+			for (int dy = -radius; dy <= radius; dy++)
+			{
+				half_widths[radius][dy + radius] = getDiscHalfWidth(radius, dy);
+			}
+		}
+	}
+};
+
+const DiscSprites disc_sprites;
+
+// filled disc, one clipped horizontal span per row
+void drawCircle(Framebuffer& img, const ClipRect& clip, int cx, int cy, int radius, uint32_t color = packRGB(255, 255, 255))
+{
+	if (radius < 0)
+	{
+		return;
+	}
+
+	// only the rows inside the clip rect
+	// (in 64 bits, far off-screen centers come in close to the int limits)
+	long long dy_min = max(-(long long)radius, (long long)clip.y0 - cy);
+	long long dy_max = min((long long)radius, (long long)clip.y1 - 1 - cy);
+	if (dy_min > dy_max)
+	{
+		return;
+	}
+
+	const int* sprite = nullptr;
+	if (radius <= DISC_SPRITE_MAX_RADIUS)
+	{
+		sprite = disc_sprites.half_widths[radius];
+
+		// whole sprite inside the clip rect, which is nearly every star: no clipping per row
+		if (dy_max - dy_min == 2 * radius && cx - radius >= clip.x0 && cx + radius < clip.x1)
+		{
+			for (int dy = -radius; dy <= radius; dy++)
+			{
+				int half_width = sprite[dy + radius];
+				uint32_t* px = img.row(cy + dy) + cx;
+				for (int dx = -half_width; dx <= half_width; dx++)
+				{
+					px[dx] = color;
+				}
+			}
+			return;
+		}
+	}
+
+	for (long long dy = dy_min; dy <= dy_max; ++dy)
+	{
+		long long half_width = sprite ? sprite[dy + radius] : getDiscHalfWidth(radius, dy);
+		long long x0 = max((long long)cx - half_width, (long long)clip.x0);
+		long long x1 = min((long long)cx + half_width + 1, (long long)clip.x1);
+		uint32_t* px = img.row(cy + dy);
+		if (x1 - x0 >= 8)
+		{
+			fillPixels(px + x0, x1 - x0, color);
+		}
+		else
+		{
+			// sprite rows are a few pixels, not worth lining up for 16-byte stores
+			for (long long x = x0; x < x1; x++)
+			{
+				px[x] = color;
+			}
+		}
+	}
+}
+
+// the old per-pixel disc, kept as the reference for -bench discs
+void drawCircleReference(Framebuffer& img, const ClipRect& clip, int cx, int cy, int radius, uint32_t color)
+{
+	long long dy_min = max(-(long long)radius, (long long)clip.y0 - cy);
+	long long dy_max = min((long long)radius, (long long)clip.y1 - 1 - cy);
+	long long dx_min = max(-(long long)radius, (long long)clip.x0 - cx);
+	long long dx_max = min((long long)radius, (long long)clip.x1 - 1 - cx);
+	if (dy_min > dy_max || dx_min > dx_max)
+	{
+		return;
+	}
+
+	for (int dy = dy_min; dy <= dy_max; ++dy)
+	{
+		for (int dx = dx_min; dx <= dx_max; ++dx)
+		{
+			if ((long long)dx * dx + (long long)dy * dy <= (long long)radius * radius)
+			{
+				img.setPixel(cx + dx, cy + dy, color);
+			}
+		}
+	}
+}
+
+// Bresenham from (x0, y0) to (x1, y1), the endpoints should already be clipped to the image (see clipLine())
+// only the pixels inside the clip rect are written, and since the walk is monotonic in x and y, it can stop as soon
+// as it has passed through the rect. the path doesn't depend on the rect, so image tiles line up pixel for pixel
+void drawLine(Framebuffer& img, const ClipRect& clip, int x0, int y0, int x1, int y1, uint32_t color)
+{
+	int dx = std::abs(x1 - x0);
+	int dy = -std::abs(y1 - y0);
+	int sx = (x0 < x1) ? 1 : -1;
+	int sy = (y0 < y1) ? 1 : -1;
+	int err = dx + dy; // error value
+
+	bool entered = false;
+	while (true)
+	{
+		if (clip.contains(x0, y0))
+		{
+			img.setPixel(x0, y0, color);
+			entered = true;
+		}
+		else if (entered)
+		{
+			break; // left the rect, and a monotonic path can't come back in
+		}
+
+		if (x0 == x1 && y0 == y1) 
+		{
+			break;
+		}
+
+		int e2 = 2 * err;
+
+		if (e2 >= dy)
+		{
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx)
+		{
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+// Liang-Barsky, trims the segment to [x_min, x_max] x [y_min, y_max], false when none of it is inside
+// endpoints that are already inside come back untouched
+bool clipLine(double& x0, double& y0, double& x1, double& y1, double x_min, double y_min, double x_max, double y_max)
+{
+	double dx = x1 - x0;
+	double dy = y1 - y0;
+	double p[4] = { -dx, dx, -dy, dy };
+	double q[4] = { x0 - x_min, x_max - x0, y0 - y_min, y_max - y0 };
+
+	double t0 = 0;
+	double t1 = 1;
+	for (int k = 0; k < 4; k++)
+	{
+		if (p[k] == 0)
+		{
+			if (q[k] < 0)
+			{
+				return false; // parallel to this edge and outside of it
+			}
+			continue;
+		}
+
+		double t = q[k] / p[k];
+		if (p[k] < 0)
+		{
+			if (t > t1)
+			{
+				return false;
+			}
+			t0 = max(t0, t);
+		}
+		else
+		{
+			if (t < t0)
+			{
+				return false;
+			}
+			t1 = min(t1, t);
+		}
+	}
+
+	if (t1 < 1)
+	{
+		x1 = x0 + t1 * dx;
+		y1 = y0 + t1 * dy;
+	}
+	if (t0 > 0)
+	{
+		x0 = x0 + t0 * dx;
+		y0 = y0 + t0 * dy;
+	}
+	return true;
+}
+
+// the old unclipped line drawing, kept as the reference for -bench lines
+// drops the whole segment when any coordinate is negative and otherwise walks every pixel, on screen or not
+void drawLineReference(Framebuffer& img, int x0, int y0, int x1, int y1, uint32_t color)
+{
+	if (x0 < 0 || y0 < 0 || x1 < 0 || y1 < 0)
+	{
+		return;
+	}
+
+	int dx = std::abs(x1 - x0);
+	int dy = -std::abs(y1 - y0);
+	int sx = (x0 < x1) ? 1 : -1;
+	int sy = (y0 < y1) ? 1 : -1;
+	int err = dx + dy; // error value
+
+	int iters = 0;
+	const int MAXITERS = max(img.width, img.height) * 2;
+
+	while (true)
+	{
+		if (img.contains(x0, y0))
+		{
+			img.setPixel(x0, y0, color);
+		}
+
+		if (x0 == x1 && y0 == y1) 
+		{
+			break;
+		}
+
+		int e2 = 2 * err;
+
+		if (e2 >= dy)
+		{
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx)
+		{
+			err += dx;
+			y0 += sy;
+		}
+
+		iters++;
+
+		if (iters > MAXITERS) // failsafe
+		{
+			break;
+		}
+	}
+}
+
+// the old per-sample orbit sampler, kept as the reference for -bench orbits
+std::vector<Vec3> getKeplerOrbitPointsReference(Vec3 p, Vec3 v, int N_points = 720)
+{
+	// returns {sma, eccentricity, inclination, omega, arg_periapsis, true_anomaly, mean_anomaly}
+	std::vector<double> orbital_elems = eclStateVector2Kepler(p, v);
+
+	double a = orbital_elems[0];
+	double e = orbital_elems[1];
+	double i = deg2rad(orbital_elems[2]);
+	double omega = deg2rad(orbital_elems[3]);
+	double arg_periapsis = deg2rad(orbital_elems[4]);
+
+	std::vector<Vec3> orbit_points;
+
+	if (e < 1)
+	{
+		// use (N_points + 1) points to close the curve
+		for (int k = 0; k < N_points + 1; ++k)
+		{
+			double nu = 2.0 * pi_c() * k / N_points; // true anomaly
+
+			// Compute radius in orbital plane
+			double r = a * (1 - e * e) / (1 + e * cos(nu));
+			double x_orb = r * cos(nu);
+			double y_orb = r * sin(nu);
+			double z_orb = 0;
+
+			// orbital transformation
+			double cos_o = cos(omega);
+			double sin_o = sin(omega);
+			double cos_i = cos(i);
+			double sin_i = sin(i);
+			double cos_w = cos(arg_periapsis);
+			double sin_w = sin(arg_periapsis);
+
+			// position in orbital plane
+			double x1 = cos_w * x_orb - sin_w * y_orb;
+			double y1 = sin_w * x_orb + cos_w * y_orb;
+			double z1 = 0;
+
+			// rotate by inclination
+			double x2 = x1;
+			double y2 = cos_i * y1;
+			double z2 = sin_i * y1;
+
+			// rotate by longitude of ascending node
+			double x = cos_o * x2 - sin_o * y2;
+			double y = sin_o * x2 + cos_o * y2;
+			double z = z2;
+
+			orbit_points.push_back(Vec3(x, y, z));
+		}
+	}
+	else // para- or hyperbolic orbit, only render around periapsis
+	{
+		// no need to close an open curve
+		for (int k = 0; k < N_points; ++k)
+		{
+			double nu = deg2rad(-85.0) + deg2rad(170.0) * k / (N_points - 1); // true anomaly
+
+			// Compute radius in orbital plane
+			double r = a * (1 - e * e) / (1 + e * cos(nu));
+			double x_orb = r * cos(nu);
+			double y_orb = r * sin(nu);
+			double z_orb = 0;
+
+			// orbital transformation
+			double cos_o = cos(omega);
+			double sin_o = sin(omega);
+			double cos_i = cos(i);
+			double sin_i = sin(i);
+			double cos_w = cos(arg_periapsis);
+			double sin_w = sin(arg_periapsis);
+
+			// position in orbital plane
+			double x1 = cos_w * x_orb - sin_w * y_orb;
+			double y1 = sin_w * x_orb + cos_w * y_orb;
+			double z1 = 0;
+
+			// rotate by inclination
+			double x2 = x1;
+			double y2 = cos_i * y1;
+			double z2 = sin_i * y1;
+
+			// rotate by longitude of ascending node
+			double x = cos_o * x2 - sin_o * y2;
+			double y = sin_o * x2 + cos_o * y2;
+			double z = z2;
+
+			orbit_points.push_back(Vec3(x, y, z));
+		}
+	}
+
+	return orbit_points;
+}
+
+// straight from the state vectors rather than through the angles of eclStateVector2Kepler(), which only keep the
+// orbital plane to a few 1e-10 (fractions of a km), and a camera riding the body has to be in its own orbit's plane
+OrbitCurve getOrbitCurve(Vec3 p, Vec3 v, double mu = 1.3271244004193938E+11)
+{
+	Vec3 h = p.cross(v);
+	Vec3 W = h.normalized(); // orbit normal
+	Vec3 e_vec = (v.cross(h) - p * (mu / p.mag())) * (1 / mu);
+
+	OrbitCurve curve;
+	curve.semi_latus = h.dot(h) / mu;
+	curve.e = e_vec.mag();
+
+	// a circular orbit has no periapsis, start at the ascending node (or +x) like eclStateVector2Kepler() does
+	if (curve.e > 1e-12)
+	{
+		curve.P = e_vec * (1 / curve.e);
+	}
+	else
+	{
+		Vec3 node = Vec3(0, 0, 1).cross(h);
+		curve.P = node.mag() > 0 ? node.normalized() : Vec3(1, 0, 0);
+	}
+	curve.Q = W.cross(curve.P);
+
+	if (curve.e < 1)
+	{
+		curve.nu_start = 0;
+		curve.nu_end = 2.0 * pi_c();
+		curve.closed = true;
+	}
+	else // para- or hyperbolic orbit, only render around periapsis
+	{
+		curve.nu_start = deg2rad(-85.0);
+		curve.nu_end = deg2rad(85.0);
+		curve.closed = false;
+	}
+
+	return curve;
+}
+
+Vec3 getOrbitPoint(const OrbitCurve& curve, double nu)
+{
+	double r = curve.semi_latus / (1 + curve.e * cos(nu));
+	double x_orb = r * cos(nu);
+	double y_orb = r * sin(nu);
+	return Vec3(x_orb * curve.P.x + y_orb * curve.Q.x, x_orb * curve.P.y + y_orb * curve.Q.y, x_orb * curve.P.z + y_orb * curve.Q.z);
+}
+
+const int ORBIT_SAMPLE_BATCH = 16; // samples between exact sin/cos, the recurrence drifts by about an ulp per step
+
+// samples the curve at uniform true anomaly steps into out, the points getKeplerOrbitPointsReference() gives (to about
+// 1e-11, that one goes through the orbital elements in degrees)
+// closed orbits get N_points + 1 samples so the curve closes, open ones N_points around periapsis
+// the true anomalies advance by a sin/cos recurrence two samples at a time, and out only reallocates when it has to grow
+void sampleKeplerOrbit(const OrbitCurve& curve, Polyline& out, int N_points = 720)
+{
+	int N_samples = curve.closed ? N_points + 1 : N_points;
+	double nu_start = curve.nu_start;
+	double nu_step = (curve.nu_end - curve.nu_start) / (N_samples - 1);
+
+	out.x.resize(N_samples);
+	out.y.resize(N_samples);
+	out.z.resize(N_samples);
+
+	__m128d semi_latus = _mm_set1_pd(curve.semi_latus);
+	__m128d ecc = _mm_set1_pd(curve.e);
+	__m128d one = _mm_set1_pd(1);
+	__m128d px_2 = _mm_set1_pd(curve.P.x);
+	__m128d py_2 = _mm_set1_pd(curve.P.y);
+	__m128d pz_2 = _mm_set1_pd(curve.P.z);
+	__m128d qx_2 = _mm_set1_pd(curve.Q.x);
+	__m128d qy_2 = _mm_set1_pd(curve.Q.y);
+	__m128d qz_2 = _mm_set1_pd(curve.Q.z);
+	__m128d cos_step = _mm_set1_pd(cos(2 * nu_step)); // each lane moves two samples ahead
+	__m128d sin_step = _mm_set1_pd(sin(2 * nu_step));
+
+	int k = 0;
+	__m128d cos_nu = one;
+	__m128d sin_nu = _mm_setzero_pd();
+	for (; k + 2 <= N_samples; k += 2)
+	{
+		// exact values at the start of every batch keep the recurrence from drifting
+		if (k % ORBIT_SAMPLE_BATCH == 0)
+		{
+			double nu_0 = nu_start + nu_step * k;
+			double nu_1 = nu_start + nu_step * (k + 1);
+			cos_nu = _mm_set_pd(cos(nu_1), cos(nu_0));
+			sin_nu = _mm_set_pd(sin(nu_1), sin(nu_0));
+		}
+		else
+		{
+			__m128d cos_next = _mm_sub_pd(_mm_mul_pd(cos_nu, cos_step), _mm_mul_pd(sin_nu, sin_step));
+			sin_nu = _mm_add_pd(_mm_mul_pd(sin_nu, cos_step), _mm_mul_pd(cos_nu, sin_step));
+			cos_nu = cos_next;
+		}
+
+		// radius and position in the orbital plane
+		__m128d r = _mm_div_pd(semi_latus, _mm_add_pd(one, _mm_mul_pd(ecc, cos_nu)));
+		__m128d x_orb = _mm_mul_pd(r, cos_nu);
+		__m128d y_orb = _mm_mul_pd(r, sin_nu);
+
+		_mm_storeu_pd(&out.x[k], _mm_add_pd(_mm_mul_pd(x_orb, px_2), _mm_mul_pd(y_orb, qx_2)));
+		_mm_storeu_pd(&out.y[k], _mm_add_pd(_mm_mul_pd(x_orb, py_2), _mm_mul_pd(y_orb, qy_2)));
+		_mm_storeu_pd(&out.z[k], _mm_add_pd(_mm_mul_pd(x_orb, pz_2), _mm_mul_pd(y_orb, qz_2)));
+	}
+
+	// odd sample count, the closing point of a closed orbit
+	for (; k < N_samples; k++)
+	{
+		Vec3 point = getOrbitPoint(curve, nu_start + nu_step * k);
+		out.x[k] = point.x;
+		out.y[k] = point.y;
+		out.z[k] = point.z;
+	}
+
+	computeChunkBounds(out);
+}
+
+// sin and cos of two angles at once, for |x| up to a few thousand rad
+// reduced by pi/2 in two steps (Cody-Waite) to [-pi/4, pi/4], where the fdlibm kernel polynomials are good to
+// about an ulp, then the quadrant picks which of the two goes where and with what sign
+void sinCos2(__m128d x, __m128d& sin_x, __m128d& cos_x)
+{
+	const __m128d two_over_pi = _mm_set1_pd(6.36619772367581382433e-01);
+	const __m128d pio2_hi = _mm_set1_pd(1.57079632673412561417e+00); // first 33 bits of pi/2
+	const __m128d pio2_lo = _mm_set1_pd(6.07710050650619224932e-11); // pi/2 - pio2_hi
+
+	__m128i quadrant = _mm_cvtpd_epi32(_mm_mul_pd(x, two_over_pi)); // rounds to nearest
+	__m128d k = _mm_cvtepi32_pd(quadrant);
+	__m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(k, pio2_hi)), _mm_mul_pd(k, pio2_lo));
+	__m128d z = _mm_mul_pd(r, r);
+
+	__m128d s = _mm_add_pd(_mm_set1_pd(-2.50507602534068634195e-08), _mm_mul_pd(z, _mm_set1_pd(1.58969099521155010221e-10)));
+	s = _mm_add_pd(_mm_set1_pd(2.75573137070700676789e-06), _mm_mul_pd(z, s));
+	s = _mm_add_pd(_mm_set1_pd(-1.98412698298579493134e-04), _mm_mul_pd(z, s));
+	s = _mm_add_pd(_mm_set1_pd(8.33333333332248946124e-03), _mm_mul_pd(z, s));
+	s = _mm_add_pd(_mm_set1_pd(-1.66666666666666324348e-01), _mm_mul_pd(z, s));
+	s = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), s));
+
+	__m128d c = _mm_add_pd(_mm_set1_pd(2.08757232129817482790e-09), _mm_mul_pd(z, _mm_set1_pd(-1.13596475577881948265e-11)));
+	c = _mm_add_pd(_mm_set1_pd(-2.75573143513906633035e-07), _mm_mul_pd(z, c));
+	c = _mm_add_pd(_mm_set1_pd(2.48015872894767294178e-05), _mm_mul_pd(z, c));
+	c = _mm_add_pd(_mm_set1_pd(-1.38888888888741095749e-03), _mm_mul_pd(z, c));
+	c = _mm_add_pd(_mm_set1_pd(4.16666666666666019037e-02), _mm_mul_pd(z, c));
+	c = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1), _mm_mul_pd(_mm_set1_pd(0.5), z)), _mm_mul_pd(_mm_mul_pd(z, z), c));
+
+	// quadrants 1 and 3 swap sin and cos, sin is negated in 2 and 3, cos in 1 and 2
+	__m128i q = _mm_shuffle_epi32(quadrant, _MM_SHUFFLE(1, 1, 0, 0)); // each lane's quadrant in both of its halves
+	__m128i one = _mm_set1_epi32(1);
+	__m128i two = _mm_set1_epi32(2);
+	__m128i sign_bits = _mm_set_epi32((int)0x80000000, 0, (int)0x80000000, 0);
+	__m128d swap = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+	__m128d sin_sign = _mm_castsi128_pd(_mm_and_si128(_mm_slli_epi32(_mm_and_si128(q, two), 30), sign_bits));
+	__m128d cos_sign = _mm_castsi128_pd(_mm_and_si128(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30), sign_bits));
+
+	sin_x = _mm_xor_pd(_mm_or_pd(_mm_and_pd(swap, c), _mm_andnot_pd(swap, s)), sin_sign);
+	cos_x = _mm_xor_pd(_mm_or_pd(_mm_and_pd(swap, s), _mm_andnot_pd(swap, c)), cos_sign);
+}
+
+const int POPULATION_BLOCK = 16384; // objects per work item when propagating or projecting in parallel
+const double KEPLER_TOLERANCE = 1e-12; // rad, Newton steps stop once the correction is below this
+const int KEPLER_MAX_ITERATIONS = 32;
+
+// heliocentric J2000 ecliptic positions of a population at one epoch
+struct PopulationPoints
+{
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> z;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+};
+
+// one object with libm and plain Newton, the reference for -bench population
+Vec3 propagatePopulationObject(const Population& population, size_t idx, double et)
+{
+	double ecc = population.e[idx];
+	double M = remainder(population.M_ref[idx] + population.n[idx] * et, 2 * PI);
+
+	double E = M + (M < 0 ? -0.85 : 0.85) * ecc; // Danby's start, converges for any e < 1
+	for (int idx_iter = 0; idx_iter < KEPLER_MAX_ITERATIONS; idx_iter++)
+	{
+		double dE = (E - ecc * sin(E) - M) / (1 - ecc * cos(E));
+		E -= dE;
+		if (abs(dE) < KEPLER_TOLERANCE)
+		{
+			break;
+		}
+	}
+
+	double x_orb = cos(E) - ecc;
+	double y_orb = sin(E);
+	return Vec3(x_orb * population.Px[idx] + y_orb * population.Qx[idx], x_orb * population.Py[idx] + y_orb * population.Qy[idx],
+		x_orb * population.Pz[idx] + y_orb * population.Qz[idx]);
+}
+
+// positions of objects [first, last) at et, two at a time with SSE2
+// both lanes take Newton steps until both have converged, a lane that is already there just stays put
+// (the position uses sin and cos of E from before the last step, which is less than 1e-12 rad off)
+void propagatePopulation(const Population& population, double et, PopulationPoints& out, size_t first, size_t last)
+{
+	__m128d et_2 = _mm_set1_pd(et);
+	__m128d two_pi = _mm_set1_pd(2 * PI);
+	__m128d inv_two_pi = _mm_set1_pd(1 / (2 * PI));
+	__m128d one = _mm_set1_pd(1);
+	__m128d danby = _mm_set1_pd(0.85);
+	__m128d zero = _mm_setzero_pd();
+	__m128d tolerance = _mm_set1_pd(KEPLER_TOLERANCE);
+	__m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+
+	size_t idx = first;
+	for (; idx + 2 <= last; idx += 2)
+	{
+		__m128d ecc = _mm_loadu_pd(&population.e[idx]);
+		__m128d M = _mm_add_pd(_mm_loadu_pd(&population.M_ref[idx]), _mm_mul_pd(_mm_loadu_pd(&population.n[idx]), et_2));
+		M = _mm_sub_pd(M, _mm_mul_pd(two_pi, _mm_cvtepi32_pd(_mm_cvtpd_epi32(_mm_mul_pd(M, inv_two_pi))))); // into [-pi, pi]
+
+		__m128d start = _mm_mul_pd(danby, ecc);
+		__m128d negative = _mm_cmplt_pd(M, zero);
+		__m128d E = _mm_add_pd(M, _mm_or_pd(_mm_and_pd(negative, _mm_sub_pd(zero, start)), _mm_andnot_pd(negative, start)));
+
+		__m128d sin_E, cos_E;
+		for (int idx_iter = 0; idx_iter < KEPLER_MAX_ITERATIONS; idx_iter++)
+		{
+			sinCos2(E, sin_E, cos_E);
+			__m128d residual = _mm_sub_pd(_mm_sub_pd(E, _mm_mul_pd(ecc, sin_E)), M);
+			__m128d dE = _mm_div_pd(residual, _mm_sub_pd(one, _mm_mul_pd(ecc, cos_E)));
+			E = _mm_sub_pd(E, dE);
+			if (_mm_movemask_pd(_mm_cmpge_pd(_mm_and_pd(dE, abs_mask), tolerance)) == 0)
+			{
+				break;
+			}
+		}
+
+		__m128d x_orb = _mm_sub_pd(cos_E, ecc);
+		_mm_storeu_pd(&out.x[idx], _mm_add_pd(_mm_mul_pd(x_orb, _mm_loadu_pd(&population.Px[idx])), _mm_mul_pd(sin_E, _mm_loadu_pd(&population.Qx[idx]))));
+		_mm_storeu_pd(&out.y[idx], _mm_add_pd(_mm_mul_pd(x_orb, _mm_loadu_pd(&population.Py[idx])), _mm_mul_pd(sin_E, _mm_loadu_pd(&population.Qy[idx]))));
+		_mm_storeu_pd(&out.z[idx], _mm_add_pd(_mm_mul_pd(x_orb, _mm_loadu_pd(&population.Pz[idx])), _mm_mul_pd(sin_E, _mm_loadu_pd(&population.Qz[idx]))));
+	}
+
+	for (; idx < last; idx++)
+	{
+		Vec3 pos = propagatePopulationObject(population, idx, et);
+		out.x[idx] = pos.x;
+		out.y[idx] = pos.y;
+		out.z[idx] = pos.z;
+	}
+}
+
+// everything needed to project a point to the screen, computed once per view
+struct Camera
+{
+	Vec3 pos;
+	Vec3 right; // OpenGL-esque, the camera looks down -z of its orientation
+	Vec3 up;
+	Vec3 forward;
+	double f; // perspective offset factor
+	int screen_x;
+	int screen_y;
+};
+
+Camera makeCamera(const Vec3& cam_pos, const std::vector<Vec3>& cam_orient, double fov, int screen_x, int screen_y)
+{
+	Camera cam;
+	cam.pos = cam_pos;
+	cam.right = cam_orient[0];
+	cam.up = cam_orient[1];
+	cam.forward = -cam_orient[2];
+	cam.screen_x = screen_x;
+	cam.screen_y = screen_y;
+
+	// the field of view spans the shorter side of the screen
+	if (min(screen_x, screen_y) == screen_x)
+	{
+		cam.f = screen_x / (2 * tan(fov / 2));
+	}
+	else
+	{
+		cam.f = screen_y / (2 * tan(fov / 2));
+	}
+
+	return cam;
+}
+
+// clip flags of a projected point
+const uint8_t CLIP_BEHIND = 1; // behind the camera, the point is reported as (-1, -1)
+const uint8_t CLIP_LEFT = 2; // x < 0
+const uint8_t CLIP_RIGHT = 4; // x >= screen_x
+const uint8_t CLIP_TOP = 8; // y < 0
+const uint8_t CLIP_BOTTOM = 16; // y >= screen_y
+
+uint8_t getClipFlags(const Camera& cam, int pix_x, int pix_y)
+{
+	return (pix_x < 0 ? CLIP_LEFT : 0) | (pix_x >= cam.screen_x ? CLIP_RIGHT : 0)
+		| (pix_y < 0 ? CLIP_TOP : 0) | (pix_y >= cam.screen_y ? CLIP_BOTTOM : 0);
+}
+
+// orbit segments are cut where they come closer to the camera plane than this (km)
+const double NEAR_CLIP_DIST = 1.0;
+
+// the screen position before it gets truncated to a pixel, returns the depth along the view direction
+// (only meaningful for points in front of the camera)
+double projectToScreen(const Camera& cam, const Vec3& pos, double& screen_x, double& screen_y)
+{
+	Vec3 rel_pos = pos - cam.pos;
+	double depth = rel_pos.dot(cam.forward);
+
+	double px = cam.f * rel_pos.dot(cam.right) / depth;
+	double py = cam.f * rel_pos.dot(cam.up) / depth;
+
+	screen_x = cam.screen_x / 2 + px + 0.5;
+	screen_y = cam.screen_y / 2 - py + 0.5;
+
+	return depth;
+}
+
+// returns the clip flags, points behind the camera come out as (-1, -1) like they always have
+uint8_t projectPoint(const Camera& cam, const Vec3& pos, int& pix_x, int& pix_y)
+{
+	double screen_x, screen_y;
+	double depth = projectToScreen(cam, pos, screen_x, screen_y);
+
+	if (depth < 0)
+	{
+		pix_x = -1;
+		pix_y = -1;
+		return CLIP_BEHIND | CLIP_LEFT | CLIP_TOP;
+	}
+
+	pix_x = screen_x;
+	pix_y = screen_y;
+
+	return getClipFlags(cam, pix_x, pix_y);
+}
+
+// the part of space a camera can draw into: in front of the near plane and inside the four side planes
+// a point p is inside a plane when normals[i].dot(p) >= offsets[i]
+struct Frustum
+{
+	Vec3 normals[5];
+	double offsets[5];
+};
+
+Frustum makeFrustum(const Camera& cam)
+{
+	// the extra pixels cover the rounding to pixel coordinates, like with the sky tiles
+	double tan_x = (cam.screen_x / 2 + 2) / cam.f;
+	double tan_y = (cam.screen_y / 2 + 2) / cam.f;
+
+	Frustum frustum;
+	frustum.normals[0] = cam.forward;
+	frustum.normals[1] = cam.forward * tan_x - cam.right;
+	frustum.normals[2] = cam.forward * tan_x + cam.right;
+	frustum.normals[3] = cam.forward * tan_y - cam.up;
+	frustum.normals[4] = cam.forward * tan_y + cam.up;
+
+	// the side planes go through the camera, the near plane is where orbit segments get cut
+	for (int idx_plane = 0; idx_plane < 5; idx_plane++)
+	{
+		frustum.offsets[idx_plane] = frustum.normals[idx_plane].dot(cam.pos);
+	}
+	frustum.offsets[0] += NEAR_CLIP_DIST;
+
+	return frustum;
+}
+
+// true when the box is entirely outside one of the planes, so nothing in it can be seen
+// (a box that only misses the frustum diagonally gets through, the 2D clipping takes care of that)
+bool isBoxOutside(const Frustum& frustum, const Vec3& lo, const Vec3& hi)
+{
+	for (int idx_plane = 0; idx_plane < 5; idx_plane++)
+	{
+		// the corner furthest along the normal
+		const Vec3& normal = frustum.normals[idx_plane];
+		Vec3 corner = Vec3(normal.x >= 0 ? hi.x : lo.x, normal.y >= 0 ? hi.y : lo.y, normal.z >= 0 ? hi.z : lo.z);
+		if (normal.dot(corner) < frustum.offsets[idx_plane])
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// a projected polyline, the caller keeps one around so projecting doesn't allocate once it has grown
+struct ScreenPoints
+{
+	std::vector<int> x;
+	std::vector<int> y;
+	std::vector<uint8_t> flags;
+	std::vector<double> screen_x; // before truncation, for clipping
+	std::vector<double> screen_y;
+	std::vector<double> depth;
+
+	void resize(size_t N)
+	{
+		x.resize(N);
+		y.resize(N);
+		flags.resize(N);
+		screen_x.resize(N);
+		screen_y.resize(N);
+		depth.resize(N);
+	}
+};
+
+// projectPoint() for points [first, last] of a polyline, two points at a time with SSE2
+// the arithmetic is done in the same order as projectPoint(), so both give the very same pixels
+// out is indexed like the polyline, the points outside the range are left alone
+void projectPolyline(const Camera& cam, const Polyline& line, ScreenPoints& out, size_t first, size_t last)
+{
+	size_t N = last + 1;
+	out.resize(line.size());
+
+	__m128d cam_x = _mm_set1_pd(cam.pos.x);
+	__m128d cam_y = _mm_set1_pd(cam.pos.y);
+	__m128d cam_z = _mm_set1_pd(cam.pos.z);
+	__m128d right_x = _mm_set1_pd(cam.right.x);
+	__m128d right_y = _mm_set1_pd(cam.right.y);
+	__m128d right_z = _mm_set1_pd(cam.right.z);
+	__m128d up_x = _mm_set1_pd(cam.up.x);
+	__m128d up_y = _mm_set1_pd(cam.up.y);
+	__m128d up_z = _mm_set1_pd(cam.up.z);
+	__m128d fwd_x = _mm_set1_pd(cam.forward.x);
+	__m128d fwd_y = _mm_set1_pd(cam.forward.y);
+	__m128d fwd_z = _mm_set1_pd(cam.forward.z);
+	__m128d f = _mm_set1_pd(cam.f);
+	__m128d half_x = _mm_set1_pd(cam.screen_x / 2);
+	__m128d half_y = _mm_set1_pd(cam.screen_y / 2);
+	__m128d round = _mm_set1_pd(0.5);
+	__m128d zero = _mm_setzero_pd();
+
+	size_t idx = first;
+	for (; idx + 2 <= N; idx += 2)
+	{
+		__m128d rel_x = _mm_sub_pd(_mm_loadu_pd(&line.x[idx]), cam_x);
+		__m128d rel_y = _mm_sub_pd(_mm_loadu_pd(&line.y[idx]), cam_y);
+		__m128d rel_z = _mm_sub_pd(_mm_loadu_pd(&line.z[idx]), cam_z);
+
+		__m128d dot_right = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rel_x, right_x), _mm_mul_pd(rel_y, right_y)), _mm_mul_pd(rel_z, right_z));
+		__m128d dot_up = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rel_x, up_x), _mm_mul_pd(rel_y, up_y)), _mm_mul_pd(rel_z, up_z));
+		__m128d depth = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rel_x, fwd_x), _mm_mul_pd(rel_y, fwd_y)), _mm_mul_pd(rel_z, fwd_z));
+
+		__m128d px = _mm_div_pd(_mm_mul_pd(f, dot_right), depth);
+		__m128d py = _mm_div_pd(_mm_mul_pd(f, dot_up), depth);
+
+		__m128d screen_x = _mm_add_pd(_mm_add_pd(half_x, px), round);
+		__m128d screen_y = _mm_add_pd(_mm_sub_pd(half_y, py), round);
+		_mm_storeu_pd(&out.screen_x[idx], screen_x);
+		_mm_storeu_pd(&out.screen_y[idx], screen_y);
+		_mm_storeu_pd(&out.depth[idx], depth);
+
+		// truncating conversion, same as the implicit double -> int in projectPoint()
+		__m128i pix_x = _mm_cvttpd_epi32(screen_x);
+		__m128i pix_y = _mm_cvttpd_epi32(screen_y);
+		_mm_storel_epi64((__m128i*)&out.x[idx], pix_x);
+		_mm_storel_epi64((__m128i*)&out.y[idx], pix_y);
+
+		int behind = _mm_movemask_pd(_mm_cmplt_pd(depth, zero));
+		for (int lane = 0; lane < 2; lane++)
+		{
+			if (behind & (1 << lane))
+			{
+				out.x[idx + lane] = -1;
+				out.y[idx + lane] = -1;
+				out.flags[idx + lane] = CLIP_BEHIND | CLIP_LEFT | CLIP_TOP;
+			}
+			else
+			{
+				out.flags[idx + lane] = getClipFlags(cam, out.x[idx + lane], out.y[idx + lane]);
+			}
+		}
+	}
+
+	for (; idx < N; idx++)
+	{
+		Vec3 pos = Vec3(line.x[idx], line.y[idx], line.z[idx]);
+		out.depth[idx] = projectToScreen(cam, pos, out.screen_x[idx], out.screen_y[idx]);
+		out.flags[idx] = projectPoint(cam, pos, out.x[idx], out.y[idx]);
+	}
+}
+
+void projectPolyline(const Camera& cam, const Polyline& line, ScreenPoints& out)
+{
+	if (line.size() > 0)
+	{
+		projectPolyline(cam, line, out, 0, line.size() - 1);
+	}
+}
+
+// a population point that didn't make it onto the screen
+const uint32_t POINT_OFFSCREEN = 0xFFFFFFFF;
+
+// pixels of population points [first, last) as x | y << 16, or POINT_OFFSCREEN for the ones behind the near plane or
+// outside the screen, two at a time with SSE2
+// the points are heliocentric, sun_pos puts them around the Sun where it is drawn
+void projectPopulation(const Camera& cam, const Vec3& sun_pos, const PopulationPoints& points, uint32_t* pixels,
+	size_t first, size_t last)
+{
+	Vec3 origin = cam.pos - sun_pos;
+	__m128d cam_x = _mm_set1_pd(origin.x);
+	__m128d cam_y = _mm_set1_pd(origin.y);
+	__m128d cam_z = _mm_set1_pd(origin.z);
+	__m128d right_x = _mm_set1_pd(cam.right.x);
+	__m128d right_y = _mm_set1_pd(cam.right.y);
+	__m128d right_z = _mm_set1_pd(cam.right.z);
+	__m128d up_x = _mm_set1_pd(cam.up.x);
+	__m128d up_y = _mm_set1_pd(cam.up.y);
+	__m128d up_z = _mm_set1_pd(cam.up.z);
+	__m128d fwd_x = _mm_set1_pd(cam.forward.x);
+	__m128d fwd_y = _mm_set1_pd(cam.forward.y);
+	__m128d fwd_z = _mm_set1_pd(cam.forward.z);
+	__m128d f = _mm_set1_pd(cam.f);
+	__m128d half_x = _mm_set1_pd(cam.screen_x / 2);
+	__m128d half_y = _mm_set1_pd(cam.screen_y / 2);
+	__m128d round = _mm_set1_pd(0.5);
+	__m128d zero = _mm_setzero_pd();
+	__m128d near_dist = _mm_set1_pd(NEAR_CLIP_DIST);
+	__m128d size_x = _mm_set1_pd(cam.screen_x);
+	__m128d size_y = _mm_set1_pd(cam.screen_y);
+
+	size_t idx = first;
+	for (; idx + 2 <= last; idx += 2)
+	{
+		__m128d rel_x = _mm_sub_pd(_mm_loadu_pd(&points.x[idx]), cam_x);
+		__m128d rel_y = _mm_sub_pd(_mm_loadu_pd(&points.y[idx]), cam_y);
+		__m128d rel_z = _mm_sub_pd(_mm_loadu_pd(&points.z[idx]), cam_z);
+
+		__m128d dot_right = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rel_x, right_x), _mm_mul_pd(rel_y, right_y)), _mm_mul_pd(rel_z, right_z));
+		__m128d dot_up = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rel_x, up_x), _mm_mul_pd(rel_y, up_y)), _mm_mul_pd(rel_z, up_z));
+		__m128d depth = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rel_x, fwd_x), _mm_mul_pd(rel_y, fwd_y)), _mm_mul_pd(rel_z, fwd_z));
+
+		__m128d screen_x = _mm_add_pd(_mm_add_pd(half_x, _mm_div_pd(_mm_mul_pd(f, dot_right), depth)), round);
+		__m128d screen_y = _mm_add_pd(_mm_sub_pd(half_y, _mm_div_pd(_mm_mul_pd(f, dot_up), depth)), round);
+
+		__m128d visible = _mm_and_pd(_mm_cmpge_pd(depth, near_dist),
+			_mm_and_pd(_mm_and_pd(_mm_cmpge_pd(screen_x, zero), _mm_cmplt_pd(screen_x, size_x)),
+				_mm_and_pd(_mm_cmpge_pd(screen_y, zero), _mm_cmplt_pd(screen_y, size_y))));
+		int visible_lanes = _mm_movemask_pd(visible);
+
+		int pix_x[4], pix_y[4];
+		_mm_storeu_si128((__m128i*)pix_x, _mm_cvttpd_epi32(screen_x));
+		_mm_storeu_si128((__m128i*)pix_y, _mm_cvttpd_epi32(screen_y));
+		for (int lane = 0; lane < 2; lane++)
+		{
+			pixels[idx + lane] = visible_lanes & (1 << lane) ? (uint32_t)pix_x[lane] | (uint32_t)pix_y[lane] << 16 : POINT_OFFSCREEN;
+		}
+	}
+
+	for (; idx < last; idx++)
+	{
+		double screen_x, screen_y;
+		double depth = projectToScreen(cam, Vec3(points.x[idx], points.y[idx], points.z[idx]) + sun_pos, screen_x, screen_y);
+		bool visible = depth >= NEAR_CLIP_DIST && screen_x >= 0 && screen_x < cam.screen_x && screen_y >= 0 && screen_y < cam.screen_y;
+		pixels[idx] = visible ? (uint32_t)screen_x | (uint32_t)screen_y << 16 : POINT_OFFSCREEN;
+	}
+}
+
+// a fixed set of worker threads fed from a bounded task queue
+// submit() blocks while the queue is full, so a fast producer can't run ahead and pile up work (and memory)
+// with no worker threads at all, tasks simply run on the caller's thread
+class WorkerPool
+{
+public:
+	WorkerPool(int N_threads, size_t capacity_p)
+	{
+		capacity = max((size_t)1, capacity_p);
+		for (int idx_thread = 0; idx_thread < N_threads; idx_thread++)
+		{
+			workers.emplace_back(&WorkerPool::workerLoop, this);
+		}
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			stopping = true;
+		}
+		not_empty.notify_all();
+
+		for (int idx_thread = 0; idx_thread < workers.size(); idx_thread++)
+		{
+			workers[idx_thread].join();
+		}
+	}
+
+	void submit(std::function<void()> task)
+	{
+		if (workers.empty())
+		{
+			task();
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		not_full.wait(lock, [this] { return tasks.size() < capacity; });
+		tasks.push_back(std::move(task));
+		N_pending++;
+		lock.unlock();
+		not_empty.notify_one();
+	}
+
+	// like submit(), but gives up instead of waiting when the queue is full
+	// a worker that hands out work of its own uses this, a blocking submit could leave every worker waiting on the queue
+	bool trySubmit(std::function<void()> task)
+	{
+		if (workers.empty())
+		{
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		if (tasks.size() >= capacity)
+		{
+			return false;
+		}
+		tasks.push_back(std::move(task));
+		N_pending++;
+		lock.unlock();
+		not_empty.notify_one();
+		return true;
+	}
+
+	// blocks until every task submitted so far has finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		all_done.wait(lock, [this] { return N_pending == 0; });
+	}
+
+	// runs fn(0) ... fn(N_items - 1) on the workers and the calling thread, returns once all of them are done
+	// unlike wait(), this only waits for its own items, so several threads can share one pool, and it is safe to
+	// call from one of the pool's own workers
+	void parallelFor(int N_items, const std::function<void(int)>& fn)
+	{
+		if (workers.empty() || N_items <= 1)
+		{
+			for (int idx_item = 0; idx_item < N_items; idx_item++)
+			{
+				fn(idx_item);
+			}
+			return;
+		}
+
+		struct Batch
+		{
+			std::atomic<int> next_item{ 0 };
+			int N_done = 0;
+			std::mutex done_mutex;
+			std::condition_variable all_done;
+		};
+		std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+
+		// items are handed out one by one, so a helper that only gets going after everything is claimed
+		// returns without touching fn
+		std::function<void()> work = [batch, N_items, &fn]() {
+			int N_finished = 0;
+			for (int idx_item = batch->next_item++; idx_item < N_items; idx_item = batch->next_item++)
+			{
+				fn(idx_item);
+				N_finished++;
+			}
+
+			if (N_finished > 0)
+			{
+				std::lock_guard<std::mutex> lock(batch->done_mutex);
+				batch->N_done += N_finished;
+				if (batch->N_done == N_items)
+				{
+					batch->all_done.notify_all();
+				}
+			}
+		};
+
+		// helpers are only a bonus, the calling thread works through whatever they don't get to
+		int N_helpers = min((int)workers.size(), N_items - 1);
+		for (int idx_helper = 0; idx_helper < N_helpers; idx_helper++)
+		{
+			if (!trySubmit(work))
+			{
+				break;
+			}
+		}
+		work();
+
+		std::unique_lock<std::mutex> lock(batch->done_mutex);
+		batch->all_done.wait(lock, [&batch, N_items] { return batch->N_done == N_items; });
+	}
+
+	int getThreadCount() const
+	{
+		return (int)workers.size();
+	}
+
+private:
+	std::vector<std::thread> workers;
+	size_t capacity;
+
+	std::mutex queue_mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::condition_variable all_done;
+	std::deque<std::function<void()>> tasks;
+	int N_pending = 0; // queued or running
+	bool stopping = false;
+
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			not_empty.wait(lock, [this] { return !tasks.empty() || stopping; });
+			if (tasks.empty())
+			{
+				return; // stopping, and nothing left to do
+			}
+
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			not_full.notify_one();
+
+			task();
+
+			lock.lock();
+			N_pending--;
+			if (N_pending == 0)
+			{
+				all_done.notify_all();
+			}
+		}
+	}
+};
+
+// ========== IMAGE OUTPUT ==========
+// every format is encoded into one contiguous buffer first and then written to disk in a single call
+
+enum class ImageFormat
+{
+	PPM, // binary P6
+	PPM_ASCII, // plain P3, the original output
+	PNG
+};
+
+std::string getImageExtension(ImageFormat format)
+{
+	if (format == ImageFormat::PNG)
+	{
+		return ".png";
+	}
+
+	return ".ppm";
+}
+
+void appendText(std::vector<unsigned char>& buf, const std::string& text)
+{
+	buf.insert(buf.end(), text.begin(), text.end());
+}
+
+void appendBigEndian32(std::vector<unsigned char>& buf, uint32_t value)
+{
+	buf.push_back((value >> 24) & 0xFF);
+	buf.push_back((value >> 16) & 0xFF);
+	buf.push_back((value >> 8) & 0xFF);
+	buf.push_back(value & 0xFF);
+}
+
+void encodePPM(const Framebuffer& img, std::vector<unsigned char>& buf)
+{
+	appendText(buf, "P6\n" + std::to_string(img.width) + " " + std::to_string(img.height) + "\n255\n");
+
+	size_t header_size = buf.size();
+	buf.resize(header_size + (size_t)img.width * img.height * 3);
+
+	unsigned char* out = buf.data() + header_size;
+	for (int y = 0; y < img.height; ++y)
+	{
+		const uint32_t* px = img.row(y);
+		for (int x = 0; x < img.width; ++x)
+		{
+			out[0] = px[x] & 0xFF;
+			out[1] = (px[x] >> 8) & 0xFF;
+			out[2] = (px[x] >> 16) & 0xFF;
+			out += 3;
+		}
+	}
+}
+
+// byte-for-byte the same as the old ofstream output, only without the stream formatting overhead
+void encodePPMAscii(const Framebuffer& img, std::vector<unsigned char>& buf)
+{
+	int screen_x = img.width;
+	int screen_y = img.height;
+	appendText(buf, "P3\n" + std::to_string(screen_x) + " " + std::to_string(screen_y) + "\n255\n");
+
+	// worst case "255 255 255 " per pixel plus a newline per row
+	size_t header_size = buf.size();
+	buf.resize(header_size + (size_t)screen_x * screen_y * 12 + screen_y);
+
+	char* out = (char*)buf.data() + header_size;
+	char* out_end = (char*)buf.data() + buf.size();
+	for (int y = 0; y < screen_y; ++y)
+	{
+		const uint32_t* px = img.row(y);
+		for (int x = 0; x < screen_x; ++x)
+		{
+			for (int idx_ch = 0; idx_ch < 3; idx_ch++)
+			{
+				out = std::to_chars(out, out_end, (px[x] >> (8 * idx_ch)) & 0xFF).ptr;
+				*out++ = ' ';
+			}
+		}
+		*out++ = '\n';
+	}
+
+	buf.resize(out - (char*)buf.data());
+}
+
+uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0)
+{
+	static const std::array<uint32_t, 256> table = []() {
+		std::array<uint32_t, 256> t;
+		for (uint32_t n = 0; n < 256; n++)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			t[n] = c;
+		}
+		return t;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+uint32_t adler32(const unsigned char* data, size_t length)
+{
+	uint32_t a = 1;
+	uint32_t b = 0;
+	while (length > 0)
+	{
+		// 5552 is the largest block that can't overflow b before the modulo
+		size_t block = min(length, (size_t)5552);
+		for (size_t i = 0; i < block; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block;
+		length -= block;
+	}
+	return (b << 16) | a;
+}
+
+// LSB-first bit packer for DEFLATE
+struct BitWriter
+{
+	std::vector<unsigned char>& buf;
+	uint64_t bits = 0;
+	int N_bits = 0;
+
+	BitWriter(std::vector<unsigned char>& buf_in) : buf(buf_in) {}
+
+	void put(uint32_t value, int count)
+	{
+		bits |= (uint64_t)value << N_bits;
+		N_bits += count;
+		while (N_bits >= 8)
+		{
+			buf.push_back(bits & 0xFF);
+			bits >>= 8;
+			N_bits -= 8;
+		}
+	}
+
+	// Huffman codes are defined MSB-first, so they go in reversed
+	void putCode(uint32_t code, int count)
+	{
+		uint32_t reversed = 0;
+		for (int i = 0; i < count; i++)
+		{
+			reversed = (reversed << 1) | ((code >> i) & 1);
+		}
+		put(reversed, count);
+	}
+
+	void flush()
+	{
+		if (N_bits > 0)
+		{
+			buf.push_back(bits & 0xFF);
+		}
+		bits = 0;
+		N_bits = 0;
+	}
+};
+
+void putFixedLiteral(BitWriter& bw, int symbol)
+{
+	if (symbol < 144)
+	{
+		bw.putCode(0x30 + symbol, 8);
+	}
+	else if (symbol < 256)
+	{
+		bw.putCode(0x190 + symbol - 144, 9);
+	}
+	else if (symbol < 280)
+	{
+		bw.putCode(symbol - 256, 7);
+	}
+	else
+	{
+		bw.putCode(0xC0 + symbol - 280, 8);
+	}
+}
+
+void putFixedMatch(BitWriter& bw, int length, int distance)
+{
+	static const int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const int length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const int dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const int dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	int idx_len = 28;
+	while (length_base[idx_len] > length)
+	{
+		idx_len--;
+	}
+	putFixedLiteral(bw, 257 + idx_len);
+	bw.put(length - length_base[idx_len], length_extra[idx_len]);
+
+	int idx_dist = 29;
+	while (dist_base[idx_dist] > distance)
+	{
+		idx_dist--;
+	}
+	bw.putCode(idx_dist, 5);
+	bw.put(distance - dist_base[idx_dist], dist_extra[idx_dist]);
+}
+
+// a single fixed-Huffman block with greedy LZ77 on a one-entry hash table, roughly zlib's "fastest" level
+// the charts are mostly black with long same-colored runs, which this catches well enough
+void deflateFast(const std::vector<unsigned char>& data, std::vector<unsigned char>& buf)
+{
+	const int HASH_BITS = 15;
+	const int WINDOW = 32768;
+	const int MAX_MATCH = 258;
+
+	std::vector<int> last_seen(1 << HASH_BITS, -WINDOW - 1);
+
+	BitWriter bw(buf);
+	bw.put(1, 1); // final block
+	bw.put(1, 2); // fixed Huffman codes
+
+	int N = data.size();
+	int pos = 0;
+	while (pos < N)
+	{
+		if (pos + 3 <= N)
+		{
+			uint32_t key = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+			uint32_t hash = (key * 2654435761u) >> (32 - HASH_BITS);
+			int candidate = last_seen[hash];
+			last_seen[hash] = pos;
+
+			if (pos - candidate <= WINDOW)
+			{
+				int max_len = min(MAX_MATCH, N - pos);
+				int len = 0;
+				while (len < max_len && data[candidate + len] == data[pos + len])
+				{
+					len++;
+				}
+
+				if (len >= 3)
+				{
+					putFixedMatch(bw, len, pos - candidate);
+					pos += len;
+					continue;
+				}
+			}
+		}
+
+		putFixedLiteral(bw, data[pos]);
+		pos++;
+	}
+
+	putFixedLiteral(bw, 256); // end of block
+	bw.flush();
+}
+
+void appendPNGChunk(std::vector<unsigned char>& buf, const char* type, const std::vector<unsigned char>& data)
+{
+	appendBigEndian32(buf, data.size());
+	size_t crc_start = buf.size();
+	buf.insert(buf.end(), type, type + 4);
+	buf.insert(buf.end(), data.begin(), data.end());
+	appendBigEndian32(buf, crc32(buf.data() + crc_start, buf.size() - crc_start));
+}
+
+void encodePNG(const Framebuffer& img, std::vector<unsigned char>& buf)
+{
+	int screen_x = img.width;
+	int screen_y = img.height;
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	buf.insert(buf.end(), signature, signature + 8);
+
+	std::vector<unsigned char> ihdr;
+	appendBigEndian32(ihdr, screen_x);
+	appendBigEndian32(ihdr, screen_y);
+	ihdr.push_back(8); // bit depth
+	ihdr.push_back(2); // truecolor RGB
+	ihdr.push_back(0); // deflate
+	ihdr.push_back(0); // adaptive filtering
+	ihdr.push_back(0); // no interlace
+	appendPNGChunk(buf, "IHDR", ihdr);
+
+	// scanlines with filter type 0, the runs of black compress fine without a predictor
+	std::vector<unsigned char> raw((size_t)(screen_x * 3 + 1) * screen_y);
+	unsigned char* out = raw.data();
+	for (int y = 0; y < screen_y; ++y)
+	{
+		*out++ = 0;
+		const uint32_t* px = img.row(y);
+		for (int x = 0; x < screen_x; ++x)
+		{
+			*out++ = px[x] & 0xFF;
+			*out++ = (px[x] >> 8) & 0xFF;
+			*out++ = (px[x] >> 16) & 0xFF;
+		}
+	}
+
+	std::vector<unsigned char> idat;
+	idat.reserve(raw.size() / 8);
+	idat.push_back(0x78); // zlib header, 32K window
+	idat.push_back(0x01); // fastest compression
+	deflateFast(raw, idat);
+	appendBigEndian32(idat, adler32(raw.data(), raw.size()));
+	appendPNGChunk(buf, "IDAT", idat);
+
+	appendPNGChunk(buf, "IEND", {});
+}
+
+void encodeImage(const Framebuffer& img, ImageFormat format, std::vector<unsigned char>& buf)
+{
+	buf.clear();
+	switch (format)
+	{
+	case ImageFormat::PPM:
+		encodePPM(img, buf);
+		break;
+	case ImageFormat::PPM_ASCII:
+		encodePPMAscii(img, buf);
+		break;
+	case ImageFormat::PNG:
+		encodePNG(img, buf);
+	}
+}
+
+bool writeFile(const std::string& filename, const std::vector<unsigned char>& buf)
+{
+	std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
+	if (!outfile)
+	{
+		std::cerr << "Could not write " << filename << "\n";
+		return false;
+	}
+
+	outfile.write((const char*)buf.data(), buf.size());
+	return outfile.good();
+}
+
+// ========== VIDEO STREAM OUTPUT ==========
+// instead of one file per view per epoch, a single view can be streamed as consecutive frames into one file or
+// a pipe, either as YUV4MPEG2 (which ffmpeg and friends read directly) or as headerless RGB24
+
+enum class StreamFormat
+{
+	Y4M,
+	RGB
+};
+
+class FrameStream
+{
+public:
+	std::string view; // topdown, edgeon or custom
+	long long N_frames_written = 0;
+
+	bool open(const std::string& path, const std::string& view_in, StreamFormat format_in, int fps, int width, int height)
+	{
+		view = view_in;
+		format = format_in;
+
+		if (path == "-")
+		{
+			_setmode(_fileno(stdout), _O_BINARY); // no CRLF translation in the middle of a frame, please
+			out = stdout;
+		}
+		else
+		{
+			out = fopen(path.c_str(), "wb");
+			if (!out)
+			{
+				std::cerr << "Could not open " << path << " for streaming\n";
+				return false;
+			}
+			owns_file = true;
+		}
+
+		if (format == StreamFormat::Y4M)
+		{
+			// full-range BT.601, the same as JPEG
+			std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height)
+				+ " F" + std::to_string(fps) + ":1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n";
+			fwrite(header.data(), 1, header.size(), out);
+		}
+
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(stream_mutex);
+		if (!pending.empty())
+		{
+			std::cerr << "Stream closed with " << pending.size() << " frames still waiting for an earlier one\n";
+		}
+
+		if (out)
+		{
+			fflush(out);
+			if (owns_file)
+			{
+				fclose(out);
+			}
+			out = nullptr;
+		}
+	}
+
+	~FrameStream()
+	{
+		close();
+	}
+
+	// thread-safe, any writer thread can encode a frame
+	void encodeFrame(const Framebuffer& img, std::vector<unsigned char>& buf) const
+	{
+		buf.clear();
+		if (format == StreamFormat::RGB)
+		{
+			buf.resize((size_t)img.width * img.height * 3);
+			unsigned char* rgb = buf.data();
+			for (int y = 0; y < img.height; ++y)
+			{
+				const uint32_t* px = img.row(y);
+				for (int x = 0; x < img.width; ++x)
+				{
+					*rgb++ = px[x] & 0xFF;
+					*rgb++ = (px[x] >> 8) & 0xFF;
+					*rgb++ = (px[x] >> 16) & 0xFF;
+				}
+			}
+			return;
+		}
+
+		// 4:2:0, the chroma planes are half size (rounded up) and each chroma sample averages a 2x2 block
+		int chroma_x = (img.width + 1) / 2;
+		int chroma_y = (img.height + 1) / 2;
+
+		static const char frame_tag[] = "FRAME\n";
+		buf.insert(buf.end(), frame_tag, frame_tag + 6);
+		size_t luma_start = buf.size();
+		buf.resize(luma_start + (size_t)img.width * img.height + 2 * (size_t)chroma_x * chroma_y);
+
+		unsigned char* luma = buf.data() + luma_start;
+		unsigned char* cb = luma + (size_t)img.width * img.height;
+		unsigned char* cr = cb + (size_t)chroma_x * chroma_y;
+
+		// 16.16 fixed point coefficients
+		for (int y = 0; y < img.height; ++y)
+		{
+			const uint32_t* px = img.row(y);
+			for (int x = 0; x < img.width; ++x)
+			{
+				int r = px[x] & 0xFF;
+				int g = (px[x] >> 8) & 0xFF;
+				int b = (px[x] >> 16) & 0xFF;
+				*luma++ = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+			}
+		}
+
+		for (int cy = 0; cy < chroma_y; ++cy)
+		{
+			const uint32_t* row0 = img.row(2 * cy);
+			const uint32_t* row1 = img.row(min(2 * cy + 1, img.height - 1));
+			for (int cx = 0; cx < chroma_x; ++cx)
+			{
+				int x0 = 2 * cx;
+				int x1 = min(2 * cx + 1, img.width - 1);
+				uint32_t block[4] = { row0[x0], row0[x1], row1[x0], row1[x1] };
+
+				int r = 0, g = 0, b = 0;
+				for (int idx_px = 0; idx_px < 4; idx_px++)
+				{
+					r += block[idx_px] & 0xFF;
+					g += (block[idx_px] >> 8) & 0xFF;
+					b += (block[idx_px] >> 16) & 0xFF;
+				}
+
+				// the sums are 4x the average, hence >> 18 instead of >> 16
+				int u = (-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18;
+				int v = (32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18;
+				*cb++ = max(0, min(255, u));
+				*cr++ = max(0, min(255, v));
+			}
+		}
+	}
+
+	// frames can finish out of order when several threads render, so early ones wait here for their turn
+	// there are only ever as many frames in flight as the render queue allows, so this stays small
+	void writeFrame(long long frame_idx, std::vector<unsigned char>& frame)
+	{
+		std::lock_guard<std::mutex> lock(stream_mutex);
+		if (frame_idx != next_frame)
+		{
+			pending[frame_idx] = std::move(frame);
+			frame.clear();
+			return;
+		}
+
+		fwrite(frame.data(), 1, frame.size(), out);
+		next_frame++;
+		N_frames_written++;
+
+		while (!pending.empty() && pending.begin()->first == next_frame)
+		{
+			fwrite(pending.begin()->second.data(), 1, pending.begin()->second.size(), out);
+			pending.erase(pending.begin());
+			next_frame++;
+			N_frames_written++;
+		}
+	}
+
+private:
+	StreamFormat format = StreamFormat::Y4M;
+	FILE* out = nullptr;
+	bool owns_file = false;
+
+	std::mutex stream_mutex;
+	long long next_frame = 0;
+	std::map<long long, std::vector<unsigned char>> pending;
+};
+
+// where a rendered view ends up: its own image file, or a frame in the stream
+struct ImageTarget
+{
+	std::string filename;
+	ImageFormat format = ImageFormat::PPM;
+	FrameStream* stream = nullptr;
+	long long frame_idx = 0;
+};
+
+// the encode + write stage, run off the render threads
+// renderers borrow a framebuffer with acquire() and hand it back through submit(), a writer thread encodes it,
+// writes it and puts it back on the free list. the framebuffers are allocated once, so when the writers fall
+// behind, acquire() blocks the renderers instead of memory growing
+class ImageWriter
+{
+public:
+	ImageWriter(int N_threads, int N_buffers) : pool(N_threads, N_buffers)
+	{
+		for (int idx_buf = 0; idx_buf < max(1, N_buffers); idx_buf++)
+		{
+			buffers.push_back(std::make_unique<Framebuffer>());
+			free_buffers.push_back(buffers.back().get());
+		}
+	}
+
+	Framebuffer& acquire()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(buffer_mutex);
+		buffer_free.wait(lock, [this] { return !free_buffers.empty(); });
+		Framebuffer* img = free_buffers.back();
+		free_buffers.pop_back();
+
+		stall_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return *img;
+	}
+
+	void submit(Framebuffer& img, const ImageTarget& target)
+	{
+		Framebuffer* img_ptr = &img;
+		pool.submit([this, img_ptr, target]() {
+			// one encode buffer per writer thread, it only ever grows to the largest image
+			static thread_local std::vector<unsigned char> buf;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (target.stream)
+			{
+				target.stream->encodeFrame(*img_ptr, buf);
+			}
+			else
+			{
+				encodeImage(*img_ptr, target.format, buf);
+			}
+			std::chrono::steady_clock::time_point encoded = std::chrono::steady_clock::now();
+
+			if (target.stream)
+			{
+				target.stream->writeFrame(target.frame_idx, buf);
+			}
+			else
+			{
+				writeFile(target.filename, buf);
+			}
+			std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+
+			std::lock_guard<std::mutex> lock(buffer_mutex);
+			encode_time += std::chrono::duration<double>(encoded - start).count();
+			write_time += std::chrono::duration<double>(written - encoded).count();
+			N_images++;
+			free_buffers.push_back(img_ptr);
+			buffer_free.notify_one();
+		});
+	}
+
+	void wait()
+	{
+		pool.wait();
+	}
+
+	int getThreadCount() const
+	{
+		return pool.getThreadCount();
+	}
+
+	int N_images = 0;
+	double encode_time = 0; // summed over writer threads
+	double write_time = 0;
+	double stall_time = 0; // summed over render threads, time spent waiting for a free framebuffer
+
+private:
+	std::mutex buffer_mutex;
+	std::condition_variable buffer_free;
+	std::vector<std::unique_ptr<Framebuffer>> buffers;
+	std::vector<Framebuffer*> free_buffers;
+
+	// last, so it is destroyed first: its destructor finishes the queued writes while the buffers are still around
+	WorkerPool pool;
+};
+
+// ========== RASTERIZATION ==========
+// a frame is first recorded as a list of screen-space draw commands in painter's order, then rasterized
+// with tile threads, every tile gets its own list of the commands overlapping it (still in order) and draws
+// them clipped to itself, so the result is identical to drawing everything in one go
+
+enum class DrawType
+{
+	CIRCLE,
+	LINE,
+	CHAR
+};
+
+struct DrawCommand
+{
+	DrawType type;
+	int x0, y0; // circle center, line start, char corner
+	int x1, y1; // line end
+	int radius;
+	uint32_t color;
+	const uint8_t* bitmap; // chars only
+};
+
+struct DisplayList
+{
+	std::vector<DrawCommand> commands;
+
+	// population points, one pixel each (see projectPopulation()), drawn after the first N_commands_under_points
+	// commands and under the rest
+	std::vector<uint32_t> point_pixels;
+	uint32_t point_color = 0;
+	int N_commands_under_points = 0;
+
+	void addCircle(int cx, int cy, int radius, uint32_t color = packRGB(255, 255, 255))
+	{
+		commands.push_back(DrawCommand{ DrawType::CIRCLE, cx, cy, 0, 0, radius, color, nullptr });
+	}
+
+	void addLine(int x0, int y0, int x1, int y1, uint32_t color)
+	{
+		commands.push_back(DrawCommand{ DrawType::LINE, x0, y0, x1, y1, 0, color, nullptr });
+	}
+
+	void addText(int x, int y, const std::string& text, uint32_t color)
+	{
+		for (char c : text)
+		{
+			commands.push_back(DrawCommand{ DrawType::CHAR, x, y, 0, 0, 0, color, font8x8_basic[(unsigned char)c] });
+			x += 8; // fixed spacing
+		}
+	}
+};
+
+void drawCommand(Framebuffer& img, const ClipRect& clip, const DrawCommand& cmd)
+{
+	switch (cmd.type)
+	{
+	case DrawType::CIRCLE:
+		drawCircle(img, clip, cmd.x0, cmd.y0, cmd.radius, cmd.color);
+		break;
+	case DrawType::LINE:
+		drawLine(img, clip, cmd.x0, cmd.y0, cmd.x1, cmd.y1, cmd.color);
+		break;
+	case DrawType::CHAR:
+		drawChar(img, clip, cmd.x0, cmd.y0, cmd.bitmap, cmd.color);
+	}
+}
+
+// screen-space bounds of everything a command could draw, not clipped to the image yet
+void getCommandBounds(const DrawCommand& cmd, long long& x_min, long long& y_min, long long& x_max, long long& y_max)
+{
+	switch (cmd.type)
+	{
+	case DrawType::CIRCLE:
+		x_min = (long long)cmd.x0 - cmd.radius;
+		x_max = (long long)cmd.x0 + cmd.radius;
+		y_min = (long long)cmd.y0 - cmd.radius;
+		y_max = (long long)cmd.y0 + cmd.radius;
+		break;
+	case DrawType::LINE:
+		x_min = min(cmd.x0, cmd.x1);
+		x_max = max(cmd.x0, cmd.x1);
+		y_min = min(cmd.y0, cmd.y1);
+		y_max = max(cmd.y0, cmd.y1);
+		break;
+	case DrawType::CHAR:
+		x_min = cmd.x0;
+		x_max = (long long)cmd.x0 + 7;
+		y_min = cmd.y0;
+		y_max = (long long)cmd.y0 + 7;
+	}
+}
+
+const int RASTER_TILE_SIZE = 256; // pixels
+
+// clears img and draws the list into it, split into tiles over tile_pool if it has any threads
+// the population layer, a single thread writing scattered pixels, which is memory bound anyway
+void splatPoints(Framebuffer& img, const DisplayList& list)
+{
+	const uint32_t* pixels = list.point_pixels.data();
+	size_t N_points = list.point_pixels.size();
+	for (size_t idx_point = 0; idx_point < N_points; idx_point++)
+	{
+		if (pixels[idx_point] != POINT_OFFSCREEN)
+		{
+			img.setPixel(pixels[idx_point] & 0xFFFF, pixels[idx_point] >> 16, list.point_color);
+		}
+	}
+}
+
+void rasterizeDisplayList(Framebuffer& img, const DisplayList& list, WorkerPool* tile_pool, uint32_t background)
+{
+	int N_under = list.point_pixels.empty() ? (int)list.commands.size() : list.N_commands_under_points;
+
+	if (!tile_pool || tile_pool->getThreadCount() == 0)
+	{
+		img.clear(background);
+		ClipRect full = getFullClipRect(img);
+		for (int idx_cmd = 0; idx_cmd < N_under; idx_cmd++)
+		{
+			drawCommand(img, full, list.commands[idx_cmd]);
+		}
+		splatPoints(img, list);
+		for (int idx_cmd = N_under; idx_cmd < list.commands.size(); idx_cmd++)
+		{
+			drawCommand(img, full, list.commands[idx_cmd]);
+		}
+		return;
+	}
+
+	int N_tiles_x = (img.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	int N_tiles_y = (img.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+
+	// binning, commands go in in order so every bin stays in painter's order
+	std::vector<std::vector<int>> bins(N_tiles_x * N_tiles_y);
+	for (int idx_cmd = 0; idx_cmd < list.commands.size(); idx_cmd++)
+	{
+		const DrawCommand& cmd = list.commands[idx_cmd];
+		long long x_min, y_min, x_max, y_max;
+		getCommandBounds(cmd, x_min, y_min, x_max, y_max);
+		if (x_max < 0 || y_max < 0 || x_min >= img.width || y_min >= img.height)
+		{
+			continue;
+		}
+
+		int tx_min = max(x_min, 0LL) / RASTER_TILE_SIZE;
+		int tx_max = min(x_max, (long long)img.width - 1) / RASTER_TILE_SIZE;
+		int ty_min = max(y_min, 0LL) / RASTER_TILE_SIZE;
+		int ty_max = min(y_max, (long long)img.height - 1) / RASTER_TILE_SIZE;
+		for (int ty = ty_min; ty <= ty_max; ty++)
+		{
+			for (int tx = tx_min; tx <= tx_max; tx++)
+			{
+				bins[ty * N_tiles_x + tx].push_back(idx_cmd);
+			}
+		}
+	}
+
+	// the tiles are drawn up to the population layer, then the points go in, then the tiles get the rest
+	// (bins are in painter's order, so each pass is a contiguous run of every bin)
+	std::vector<int> bin_split(bins.size());
+	for (int idx_tile = 0; idx_tile < bins.size(); idx_tile++)
+	{
+		bin_split[idx_tile] = std::lower_bound(bins[idx_tile].begin(), bins[idx_tile].end(), N_under) - bins[idx_tile].begin();
+	}
+
+	for (int idx_pass = 0; idx_pass < 2; idx_pass++)
+	{
+		if (idx_pass == 1)
+		{
+			if (list.point_pixels.empty())
+			{
+				break;
+			}
+			splatPoints(img, list);
+		}
+
+		tile_pool->parallelFor(N_tiles_x * N_tiles_y, [&](int idx_tile) {
+			int tx = idx_tile % N_tiles_x;
+			int ty = idx_tile / N_tiles_x;
+			ClipRect clip = { tx * RASTER_TILE_SIZE, ty * RASTER_TILE_SIZE,
+				min((tx + 1) * RASTER_TILE_SIZE, img.width), min((ty + 1) * RASTER_TILE_SIZE, img.height) };
+
+			const std::vector<int>& bin = bins[idx_tile];
+			int bin_begin = idx_pass == 0 ? 0 : bin_split[idx_tile];
+			int bin_end = idx_pass == 0 ? bin_split[idx_tile] : (int)bin.size();
+
+			// the clear is split up too, at 16K it is half a gigabyte of stores
+			if (idx_pass == 0)
+			{
+				for (int y = clip.y0; y < clip.y1; y++)
+				{
+					img.fillSpan(y, clip.x0, clip.x1, background);
+				}
+			}
+
+			for (int idx_bin = bin_begin; idx_bin < bin_end; idx_bin++)
+			{
+				drawCommand(img, clip, list.commands[bin[idx_bin]]);
+			}
+		});
+	}
+}
+
+// adds the visible parts of the segments between points [first, last] of a projected polyline
+// segments crossing the near plane are cut in 3D first, then everything is clipped to the screen in 2D
+void addPolyline(DisplayList& list, const Camera& cam, const Polyline& line, const ScreenPoints& points, uint32_t color,
+	int first, int last)
+{
+	// keeps the truncated pixel coordinates inside the image
+	double x_max = cam.screen_x - 1e-6;
+	double y_max = cam.screen_y - 1e-6;
+
+	for (int idx_op = first; idx_op < last; idx_op++)
+	{
+		int idx_1 = idx_op;
+		int idx_2 = idx_op + 1;
+		bool in_front_1 = points.depth[idx_1] >= NEAR_CLIP_DIST;
+		bool in_front_2 = points.depth[idx_2] >= NEAR_CLIP_DIST;
+		if (!in_front_1 && !in_front_2)
+		{
+			continue;
+		}
+
+		// the common case, nothing to clip
+		if (in_front_1 && in_front_2 && points.flags[idx_1] == 0 && points.flags[idx_2] == 0)
+		{
+			list.addLine(points.x[idx_1], points.y[idx_1], points.x[idx_2], points.y[idx_2], color);
+			continue;
+		}
+
+		double x1 = points.screen_x[idx_1];
+		double y1 = points.screen_y[idx_1];
+		double x2 = points.screen_x[idx_2];
+		double y2 = points.screen_y[idx_2];
+
+		if (!in_front_1 || !in_front_2)
+		{
+			// replace the end behind the near plane with the point where the segment crosses it
+			Vec3 p1 = Vec3(line.x[idx_1], line.y[idx_1], line.z[idx_1]);
+			Vec3 p2 = Vec3(line.x[idx_2], line.y[idx_2], line.z[idx_2]);
+			double t = (NEAR_CLIP_DIST - points.depth[idx_1]) / (points.depth[idx_2] - points.depth[idx_1]);
+			Vec3 p_near = p1 + (p2 - p1) * t;
+
+			if (!in_front_1)
+			{
+				projectToScreen(cam, p_near, x1, y1);
+			}
+			else
+			{
+				projectToScreen(cam, p_near, x2, y2);
+			}
+		}
+
+		if (clipLine(x1, y1, x2, y2, 0, 0, x_max, y_max))
+		{
+			list.addLine((int)x1, (int)y1, (int)x2, (int)y2, color);
+		}
+	}
+}
+
+void addPolyline(DisplayList& list, const Camera& cam, const Polyline& line, const ScreenPoints& points, uint32_t color)
+{
+	addPolyline(list, cam, line, points, color, 0, (int)line.size() - 1);
+}
+
+// segment counts of the orbits handed to addVisibleOrbit()
+struct OrbitCullStats
+{
+	long long N_segments = 0;
+	long long N_culled = 0;
+};
+
+// projects and adds only the chunks of an orbit that the frustum might see
+void addVisibleOrbit(DisplayList& list, const Camera& cam, const Frustum& frustum, const Polyline& line,
+	ScreenPoints& points, uint32_t color, OrbitCullStats* stats = nullptr)
+{
+	if (line.chunks.empty())
+	{
+		return;
+	}
+
+	if (stats)
+	{
+		stats->N_segments += line.size() - 1;
+	}
+
+	// the whole orbit first, a planet far behind the camera is done with one test
+	if (isBoxOutside(frustum, line.lo, line.hi))
+	{
+		if (stats)
+		{
+			stats->N_culled += line.size() - 1;
+		}
+		return;
+	}
+
+	for (int idx_chunk = 0; idx_chunk < line.chunks.size(); idx_chunk++)
+	{
+		const PolylineChunk& chunk = line.chunks[idx_chunk];
+		if (isBoxOutside(frustum, chunk.lo, chunk.hi))
+		{
+			if (stats)
+			{
+				stats->N_culled += chunk.last - chunk.first;
+			}
+			continue;
+		}
+
+		projectPolyline(cam, line, points, chunk.first, chunk.last);
+		addPolyline(list, cam, line, points, color, chunk.first, chunk.last);
+	}
+}
+
+// how orbits are turned into line segments
+enum class OrbitTessellation
+{
+	FIXED, // the scene's polylines, 720 uniform steps in true anomaly
+	ADAPTIVE // subdivided for each camera until every chord is close enough to the curve on screen
+};
+
+const int TESS_BASE_SEGMENTS = 64; // the coarsest split, every orbit gets at least this many segments
+const int TESS_MAX_DEPTH = 14; // halvings of a base segment, so nothing gets finer than 1/(64 * 16384) of the orbit
+const double TESS_TOLERANCE_PX = 0.25; // how far a chord may stray from the curve on screen
+
+// splits the arc from nu_a to nu_b (a and b are its end points) until the chord is within the tolerance,
+// appending every point after a, b included
+// arcs that can't be seen aren't split at all, the chord can't be seen either as long as the arc is convex
+void subdivideOrbitArc(const Camera& cam, const Frustum& frustum, const OrbitCurve& curve,
+	double nu_a, const Vec3& a, double nu_b, const Vec3& b, int depth, Polyline& out, std::vector<double>& nus)
+{
+	if (depth < TESS_MAX_DEPTH)
+	{
+		double nu_m = 0.5 * (nu_a + nu_b);
+		Vec3 m = getOrbitPoint(curve, nu_m);
+
+		// how far the arc bulges out of the chord, as seen from the camera
+		// measured on screen when the whole arc is in front (as the distance of the middle from the projected chord,
+		// an orbit seen edge-on is a straight line however coarse), else estimated from the distance
+		double sagitta = (m - (a + b) * 0.5).mag();
+		double a_x, a_y, b_x, b_y, m_x, m_y;
+		double depth_a = projectToScreen(cam, a, a_x, a_y);
+		double depth_b = projectToScreen(cam, b, b_x, b_y);
+		double depth_m = projectToScreen(cam, m, m_x, m_y);
+		double error_px;
+		if (depth_a >= NEAR_CLIP_DIST && depth_b >= NEAR_CLIP_DIST && depth_m >= NEAR_CLIP_DIST)
+		{
+			double chord_x = b_x - a_x;
+			double chord_y = b_y - a_y;
+			double chord_len = sqrt(chord_x * chord_x + chord_y * chord_y);
+			error_px = chord_len > 0 ? std::abs((m_x - a_x) * chord_y - (m_y - a_y) * chord_x) / chord_len
+				: sqrt((m_x - a_x) * (m_x - a_x) + (m_y - a_y) * (m_y - a_y));
+		}
+		else
+		{
+			error_px = cam.f * sagitta / (m - cam.pos).mag();
+		}
+
+		if (error_px > TESS_TOLERANCE_PX)
+		{
+			// the arc stays within about a sagitta of the triangle a, m, b
+			double pad = 2 * sagitta;
+			Vec3 lo = Vec3(min(min(a.x, b.x), m.x) - pad, min(min(a.y, b.y), m.y) - pad, min(min(a.z, b.z), m.z) - pad);
+			Vec3 hi = Vec3(max(max(a.x, b.x), m.x) + pad, max(max(a.y, b.y), m.y) + pad, max(max(a.z, b.z), m.z) + pad);
+			if (!isBoxOutside(frustum, lo, hi))
+			{
+				subdivideOrbitArc(cam, frustum, curve, nu_a, a, nu_m, m, depth + 1, out, nus);
+				subdivideOrbitArc(cam, frustum, curve, nu_m, m, nu_b, b, depth + 1, out, nus);
+				return;
+			}
+		}
+	}
+
+	out.x.push_back(b.x);
+	out.y.push_back(b.y);
+	out.z.push_back(b.z);
+	nus.push_back(nu_b);
+}
+
+// samples the orbit for one camera: dense where it is close or curves sharply on screen, sparse elsewhere
+// out and nus (the true anomaly of every point) are cleared first, their allocations are reused
+void tessellateOrbit(const Camera& cam, const Frustum& frustum, const OrbitCurve& curve, Polyline& out, std::vector<double>& nus)
+{
+	out.x.clear();
+	out.y.clear();
+	out.z.clear();
+	nus.clear();
+
+	double nu_step = (curve.nu_end - curve.nu_start) / TESS_BASE_SEGMENTS;
+	Vec3 a = getOrbitPoint(curve, curve.nu_start);
+	out.x.push_back(a.x);
+	out.y.push_back(a.y);
+	out.z.push_back(a.z);
+	nus.push_back(curve.nu_start);
+
+	for (int idx_seg = 0; idx_seg < TESS_BASE_SEGMENTS; idx_seg++)
+	{
+		double nu_a = curve.nu_start + nu_step * idx_seg;
+		double nu_b = idx_seg + 1 == TESS_BASE_SEGMENTS ? curve.nu_end : nu_a + nu_step;
+		Vec3 b = getOrbitPoint(curve, nu_b);
+		subdivideOrbitArc(cam, frustum, curve, nu_a, a, nu_b, b, 0, out, nus);
+		a = b;
+	}
+
+	computeChunkBounds(out);
+}
+
+// scratch space for addOrbit(), one per view so tessellating doesn't allocate for every orbit
+struct OrbitScratch
+{
+	ScreenPoints points;
+	Polyline line;
+	std::vector<double> nus;
+};
+
+void addOrbit(DisplayList& list, const Camera& cam, const Frustum& frustum, const Polyline& fixed_line,
+	const OrbitCurve& curve, OrbitTessellation tess, OrbitScratch& scratch, uint32_t color)
+{
+	if (tess == OrbitTessellation::ADAPTIVE)
+	{
+		tessellateOrbit(cam, frustum, curve, scratch.line, scratch.nus);
+		addVisibleOrbit(list, cam, frustum, scratch.line, scratch.points, color);
+	}
+	else
+	{
+		addVisibleOrbit(list, cam, frustum, fixed_line, scratch.points, color);
+	}
+}
+
+// draw a single individual image into img
+void drawSolarSystem(Framebuffer& img, WorkerPool* tile_pool, const Scene& scene,
+	const std::string& cam_mode, const Camera& cam, OrbitTessellation tess, const PopulationPoints* population)
+{
+	const Starfield& starfield = *scene.starfield;
+	const std::vector<Polyline>& major_orbits = scene.major_orbits;
+	const std::vector<Vec3>& major_pos = scene.major_pos;
+
+	int screen_x = cam.screen_x;
+	int screen_y = cam.screen_y;
+	double f = cam.f;
+	const Vec3& cam_pos = cam.pos;
+	const Vec3& cam_right = cam.right;
+	const Vec3& cam_up = cam.up;
+	const Vec3& cam_forward = cam.forward;
+
+	img.resize(screen_x, screen_y);
+	DisplayList list;
+
+	// now, we render things from back to front as basic renderers do
+	// so...
+	// draw starfield first
+	std::vector<int> visible_tiles = getVisibleSkyTiles(starfield, cam_right, cam_up, cam_forward, f, screen_x, screen_y);
+
+	for (int idx_visible = 0; idx_visible < visible_tiles.size(); idx_visible++)
+	{
+		const SkyTile& tile = starfield.tiles[visible_tiles[idx_visible]];
+
+		for (int idx_star = tile.first_star; idx_star < tile.first_star + tile.N_stars; idx_star++)
+		{
+			if (starfield.mags[idx_star] > starfield.mag_limit) // don't draw too dim stars, clutters the background
+			{
+				break; // stars are sorted by magnitude within a tile, all the rest are dimmer still
+			}
+
+			double radius = 1; // normally in EVIS we have a mag2radius but we don't really need that here
+
+			// the star's direction, precomputed in ecliptic coordinates at pseudo-infinite distance
+			Vec3 star_pos = starfield.dirs[idx_star];
+
+			// do not do this! no need! star is at infinite distance anyway!!
+			// Vec3 star_rel_pos = star_pos - cam_pos;
+
+			if (star_pos.dot(cam_forward) > 0)
+			{
+				double px = f * star_pos.dot(cam_right) / star_pos.dot(cam_forward);
+				double py = f * star_pos.dot(cam_up) / star_pos.dot(cam_forward);
+
+				int pix_x = screen_x / 2 + px + 0.5;
+				int pix_y = screen_y / 2 - py + 0.5;
+
+				list.addCircle(pix_x, pix_y, radius, packRGB(200, 200, 200));
+			}
+		}
+	}
+
+	// the minor planet population goes over the stars and under everything else
+	// projected in blocks by the tile threads, the points are splatted by the rasterizer
+	if (population && population->size() > 0)
+	{
+		list.N_commands_under_points = list.commands.size();
+		list.point_color = packRGB(110, 110, 140);
+		list.point_pixels.resize(population->size());
+
+		int N_blocks = (population->size() + POPULATION_BLOCK - 1) / POPULATION_BLOCK;
+		std::function<void(int)> project_block = [&](int idx_block) {
+			size_t first = (size_t)idx_block * POPULATION_BLOCK;
+			size_t last = min(first + POPULATION_BLOCK, population->size());
+			projectPopulation(cam, major_pos[0], *population, list.point_pixels.data(), first, last);
+		};
+
+		if (tile_pool)
+		{
+			tile_pool->parallelFor(N_blocks, project_block);
+		}
+		else
+		{
+			for (int idx_block = 0; idx_block < N_blocks; idx_block++)
+			{
+				project_block(idx_block);
+			}
+		}
+	}
+
+	// ok, next thing, orbit ellipses!
+	// minor planet orbit first
+	// (only the chunks that can be in view get projected at all)
+	Frustum frustum = makeFrustum(cam);
+	OrbitScratch orbit_scratch; // reused for every orbit
+	addOrbit(list, cam, frustum, scene.mp_orbit, scene.mp_curve, tess, orbit_scratch, packRGB(0, 255, 0));
+
+	// now the orbits of major planets (Sun orbit is not drawn, therefore index starts at 1)
+	for (int idx_major = 1; idx_major < major_orbits.size(); idx_major++)
+	{
+		addOrbit(list, cam, frustum, major_orbits[idx_major], scene.major_curves[idx_major], tess, orbit_scratch,
+			major_body_colors[idx_major]);
+	}
+
+	// now draw the objects themselves
+	// starting with the minor planet...
+	int mp_scrpos[2];
+	if (!(projectPoint(cam, scene.mp_pos, mp_scrpos[0], mp_scrpos[1]) & CLIP_BEHIND))
+	{
+		list.addCircle(mp_scrpos[0], mp_scrpos[1], 3);
+	}
+
+	// now the major bodies (this time including the Sun, of course)
+	for (int idx_major = 0; idx_major < major_orbits.size(); idx_major++)
+	{
+		int mp_scrpos[2];
+		projectPoint(cam, major_pos[idx_major], mp_scrpos[0], mp_scrpos[1]); // drawn even when behind us, at (-1, -1)
+		if (idx_major == 0)
+		{
+			// compute real angular size in pixels
+			double ang_radius = asin(major_body_radii[idx_major] / (major_pos[idx_major] - cam_pos).mag());
+			double pix_radius = f * tan(ang_radius);
+			double draw_radius = max(5, pix_radius);
+			list.addCircle(mp_scrpos[0], mp_scrpos[1], draw_radius, major_body_colors[idx_major]);
+		}
+		else
+		{
+			double ang_radius = asin(major_body_radii[idx_major] / (major_pos[idx_major] - cam_pos).mag());
+			double pix_radius = f * tan(ang_radius);
+			double draw_radius = max(3, pix_radius);
+			list.addCircle(mp_scrpos[0], mp_scrpos[1], draw_radius, major_body_colors[idx_major]);
+		}
+	}
+
+	list.addText(10, 10, scene.st.datetime, packRGB(255, 0, 0));
+
+	rasterizeDisplayList(img, list, tile_pool, packRGB(0, 0, 0));
+}
+
+// render a single individual image and queue it up for a writer thread
+void renderSolarSystem(ImageWriter& writer, WorkerPool* tile_pool, const Scene& scene,
+	const std::string& cam_mode, const Camera& cam, OrbitTessellation tess, const PopulationPoints* population, const ImageTarget& target)
+{
+	Framebuffer& img = writer.acquire();
+	drawSolarSystem(img, tile_pool, scene, cam_mode, cam, tess, population);
+	writer.submit(img, target);
+}
+
+// don't ask
+double getNextLargerOrRetain(double value, const std::vector<double>& sorted_arr)
+{
+	std::vector<double>::const_iterator it = std::upper_bound(sorted_arr.begin(), sorted_arr.end(), value);
+
+	if (it != sorted_arr.end())
+	{
+		return *it;
+	}
+	else
+	{
+		return value;
+	}
+}
+
+// when streaming, only the streamed view is rendered
+bool isViewWanted(const std::string& view, const FrameStream* stream)
+{
+	return !stream || stream->view == view;
+}
+
+ImageTarget getViewTarget(const std::string& view, const std::string& map_name, ImageFormat image_format,
+	FrameStream* stream, long long frame_idx)
+{
+	ImageTarget target;
+	target.filename = "map_" + view + "/" + map_name + "_" + view + getImageExtension(image_format);
+	target.format = image_format;
+	target.stream = stream;
+	target.frame_idx = frame_idx;
+	return target;
+}
+
+// a free camera: either parked at a spherical position around the origin or riding along with a carrier object,
+// looking at the center object
+struct ViewSpec
+{
+	std::string name; // images go to map_<name>/
+	double theta; // rad
+	double phi; // rad
+	double dist; // km
+	std::string center_obj;
+	std::string carrier_obj;
+};
+
+// a camera ready for rendering
+struct RenderView
+{
+	std::string name;
+	Vec3 cam_pos;
+	std::vector<Vec3> cam_orient;
+};
+
+RenderView getCustomView(const Scene& scene, const ViewSpec& spec)
+{
+	const std::vector<Vec3>& major_pos_eclip = scene.major_pos;
+	const Vec3& mp_pos = scene.mp_pos;
+
+	Vec3 cam_pos = -Vec3(spec.theta, spec.phi) * spec.dist;
+
+	if (strcmp(spec.carrier_obj.c_str(), "None")) // NOT equal to "None"
+	{
+		if (!strcmp(spec.carrier_obj.c_str(), "SOLAR_SYSTEM_BARYCENTER"))
+		{
+			cam_pos = Vec3(0, 0, 0);
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "SUN"))
+		{
+			cam_pos = major_pos_eclip[0];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "MERCURY_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[1];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "VENUS_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[2];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "EARTH_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[3];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "MARS_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[4];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "JUPITER_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[5];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "SATURN_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[6];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "URANUS_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[7];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "NEPTUNE_BARYCENTER"))
+		{
+			cam_pos = major_pos_eclip[8];
+		}
+		else if (!strcmp(spec.carrier_obj.c_str(), "MP"))
+		{
+			cam_pos = mp_pos;
+		}
+	}
+
+	Vec3 target_pos = Vec3(0, 0, 0);
+	if (!strcmp(spec.center_obj.c_str(), "SOLAR_SYSTEM_BARYCENTER"))
+	{
+		target_pos = Vec3(0, 0, 0);
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "SUN"))
+	{
+		target_pos = major_pos_eclip[0];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "MERCURY_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[1];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "VENUS_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[2];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "EARTH_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[3];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "MARS_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[4];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "JUPITER_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[5];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "SATURN_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[6];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "URANUS_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[7];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "NEPTUNE_BARYCENTER"))
+	{
+		target_pos = major_pos_eclip[8];
+	}
+	else if (!strcmp(spec.center_obj.c_str(), "MP"))
+	{
+		target_pos = mp_pos;
+	}
+
+	// dummy default orientation
+	std::vector<Vec3> cam_orient = {
+		Vec3(1, 0, 0),
+		Vec3(0, 1, 0),
+		Vec3(0, 0, 1)
+	};
+
+	Vec3 forward = (target_pos - cam_pos).normalized();
+	Vec3 forward_xy = Vec3(forward.x, forward.y, 0).normalized();
+	Vec3 right = Vec3(-forward_xy.y, forward_xy.x, 0);
+	Vec3 up = forward.cross(right).normalized();
+	right = up.cross(forward).normalized();
+
+	cam_orient[0] = right;
+	cam_orient[1] = up;
+	cam_orient[2] = -forward;
+
+	return RenderView{ spec.name, cam_pos, cam_orient };
+}
+
+// name,theta,phi,dist[,center[,carrier]] with angles in degrees and the distance in AU, as for -theta, -phi and -dist
+bool parseViewSpec(const std::string& text, const ViewSpec& defaults, ViewSpec& spec)
+{
+	std::vector<std::string> fields;
+	std::stringstream ss(text);
+	std::string field;
+	while (std::getline(ss, field, ','))
+	{
+		fields.push_back(field);
+	}
+
+	if (fields.size() < 4 || fields.size() > 6 || fields[0].empty())
+	{
+		return false;
+	}
+
+	spec.name = fields[0];
+	spec.theta = deg2rad(strtod(fields[1].c_str(), NULL));
+	spec.phi = deg2rad(strtod(fields[2].c_str(), NULL));
+	spec.dist = strtod(fields[3].c_str(), NULL) * AU;
+	spec.center_obj = fields.size() > 4 ? fields[4] : defaults.center_obj;
+	spec.carrier_obj = fields.size() > 5 ? fields[5] : defaults.carrier_obj;
+	return true;
+}
+
+// the cameras of an epoch: top-down, edge-on, then the custom ones
+// the first two are fitted to mp_orbit, which is the scene's own unless the orbit cache is asking ahead of time
+std::vector<RenderView> getMapViews(const Scene& scene, const Polyline& mp_orbit, double fov, const std::vector<ViewSpec>& custom_views)
+{
+	std::vector<RenderView> views;
+
+	// ========== TOP-DOWN ==========
+
+	// get the extents of the orbit of the minor planet
+	double R_mp_max = 0;
+	for (int idx_op = 0; idx_op < mp_orbit.size(); idx_op++)
+	{
+		double Rsq_current = mp_orbit.x[idx_op] * mp_orbit.x[idx_op] + mp_orbit.y[idx_op] * mp_orbit.y[idx_op];
+		if (Rsq_current > R_mp_max * R_mp_max)
+		{
+			R_mp_max = sqrt(Rsq_current);
+		}
+	}
+
+	// we will push the camera as far back to include the next planet's orbit (unless the minor planet's orbit 
+	// is larger than Neptune's, in which case we will go even farther out)
+	std::vector<double> planet_sma = { 69.8e6, 108.9e6, 152.1e6, 249.3e6, 816.4e6, 1506.5e6, 3001.4e6, 4558.9e6 };
+	double R_max = getNextLargerOrRetain(R_mp_max, planet_sma) * 1.33;
+	double fit_dist = R_max / tan(fov / 2);
+
+	Vec3 cam_pos = Vec3(0, 0, fit_dist);
+	std::vector<Vec3> cam_orient = {
+		Vec3(1, 0, 0),
+		Vec3(0, 1, 0),
+		Vec3(0, 0, 1)
+	};
+
+	views.push_back(RenderView{ "topdown", cam_pos, cam_orient });
+
+	// ========== EDGE-ON ==========
+	cam_pos = Vec3(fit_dist, 0, 0);
+	cam_orient = {
+		Vec3(0, 1, 0),
+		Vec3(0, 0, 1),
+		Vec3(1, 0, 0)
+	};
+
+	views.push_back(RenderView{ "edgeon", cam_pos, cam_orient });
+
+	// ========== CUSTOM (and any extra cameras) ==========
+	for (int idx_view = 0; idx_view < custom_views.size(); idx_view++)
+	{
+		views.push_back(getCustomView(scene, custom_views[idx_view]));
+	}
+
+	return views;
+}
+
+// distance from p to the nearest point of a box, 0 inside it
+double getBoxDistance(const Vec3& p, const Vec3& lo, const Vec3& hi)
+{
+	double dx = max(0, max(lo.x - p.x, p.x - hi.x));
+	double dy = max(0, max(lo.y - p.y, p.y - hi.y));
+	double dz = max(0, max(lo.z - p.z, p.z - hi.z));
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+const int ORBIT_CACHE_PROBES = 16; // true anomalies the cached and the new curve are compared at, periapsis and apoapsis among them
+
+// sampled orbits carried over from one epoch to the next
+// the osculating orbits hardly move between frames minutes or hours apart, so an orbit keeps its polyline (and the
+// curve it was sampled from) until the new curve has drifted further from it than tolerance_px would show in any view
+class OrbitCache
+{
+public:
+	double tolerance_px; // 0 samples every orbit again on every epoch
+	double fov; // rad
+	double f; // px per rad in the corners of the frame, where a sideways move shows up largest, same for all views
+	std::vector<ViewSpec> custom_views;
+
+	// statistics
+	long long N_hits = 0;
+	long long N_misses = 0;
+	double max_reused_drift = 0; // px, in the closest view
+
+	OrbitCache(double tolerance_px_p, double fov_deg, int screen_x, int screen_y, const std::vector<ViewSpec>& custom_views_p)
+	{
+		tolerance_px = tolerance_px_p;
+		fov = deg2rad(fov_deg);
+		custom_views = custom_views_p;
+
+		// makeCamera()'s focal length holds on the optical axis only, a ray at angle theta off it moves across the
+		// screen f / cos^2 theta = f (1 + tan^2 theta) px per rad, which peaks in the corners
+		double f_axis = min(screen_x, screen_y) / (2 * tan(fov / 2));
+		double half_diagonal = 0.5 * sqrt((double)screen_x * screen_x + (double)screen_y * screen_y);
+		f = f_axis * (1 + (half_diagonal / f_axis) * (half_diagonal / f_axis));
+	}
+
+	// the orbit in slot idx_orbit for this epoch, reused or sampled from curve
+	// cam_positions are all the cameras the epoch will be drawn from
+	void getOrbit(int idx_orbit, const OrbitCurve& curve, const std::vector<Vec3>& cam_positions, OrbitCurve& out_curve, Polyline& out_line)
+	{
+		if (idx_orbit >= entries.size())
+		{
+			entries.resize(idx_orbit + 1);
+		}
+		Entry& entry = entries[idx_orbit];
+
+		if (entry.valid && tolerance_px > 0 && entry.curve.closed == curve.closed)
+		{
+			// a point that moved by drift km at distance d shows up at most drift * f / d px away, anywhere in the frame
+			double drift = getDrift(entry.curve, curve);
+			double dist = getClosestDistance(entry.line, cam_positions);
+			if (drift * f <= tolerance_px * dist)
+			{
+				N_hits++;
+				max_reused_drift = max(max_reused_drift, drift * f / dist);
+				out_curve = entry.curve;
+				out_line = entry.line;
+				return;
+			}
+		}
+
+		N_misses++;
+		entry.valid = true;
+		entry.curve = curve;
+		sampleKeplerOrbit(curve, entry.line);
+		out_curve = entry.curve;
+		out_line = entry.line;
+	}
+
+	// the cached minor planet orbit, which the top-down and edge-on cameras get fitted to if it's reused
+	const Polyline& getCachedLine(int idx_orbit) const
+	{
+		static const Polyline empty;
+		return idx_orbit < entries.size() ? entries[idx_orbit].line : empty;
+	}
+
+	void printSummary()
+	{
+		long long N_lookups = N_hits + N_misses;
+		std::cout << "Orbit cache: " << N_hits << " of " << N_lookups << " orbits reused ("
+			<< (N_lookups > 0 ? 100.0 * N_hits / N_lookups : 0) << "% hit rate, " << N_misses << " sampled), worst reused drift "
+			<< max_reused_drift << " px (tolerance " << tolerance_px << " px)\n";
+	}
+
+private:
+	struct Entry
+	{
+		bool valid = false;
+		OrbitCurve curve;
+		Polyline line;
+	};
+	std::vector<Entry> entries;
+
+	// how far the curve has moved, in km, compared point for point at the same true anomalies
+	// (overestimates the drift of near-circular orbits whose periapsis wanders, which only costs a resample)
+	static double getDrift(const OrbitCurve& cached, const OrbitCurve& curve)
+	{
+		double drift = 0;
+		for (int idx_probe = 0; idx_probe <= ORBIT_CACHE_PROBES; idx_probe++)
+		{
+			double nu = cached.nu_start + (cached.nu_end - cached.nu_start) * idx_probe / ORBIT_CACHE_PROBES;
+			drift = max(drift, (getOrbitPoint(curve, nu) - getOrbitPoint(cached, nu)).mag());
+		}
+		return drift;
+	}
+
+	// nearest any camera gets to the cached polyline, by its chunk boxes
+	static double getClosestDistance(const Polyline& line, const std::vector<Vec3>& cam_positions)
+	{
+		double dist = INFINITY;
+		for (int idx_cam = 0; idx_cam < cam_positions.size(); idx_cam++)
+		{
+			for (int idx_chunk = 0; idx_chunk < line.chunks.size(); idx_chunk++)
+			{
+				dist = min(dist, getBoxDistance(cam_positions[idx_cam], line.chunks[idx_chunk].lo, line.chunks[idx_chunk].hi));
+			}
+		}
+		return dist;
+	}
+};
+
+std::vector<Vec3> getCameraPositions(const std::vector<RenderView>& views)
+{
+	std::vector<Vec3> cam_positions;
+	for (int idx_view = 0; idx_view < views.size(); idx_view++)
+	{
+		cam_positions.push_back(views[idx_view].cam_pos);
+	}
+	return cam_positions;
+}
+
+// computes the camera-independent part of an epoch: planet states, minor planet state and all sampled orbits
+// this is where all the per-epoch SPICE work happens, so it stays on the main thread (and so does the orbit cache)
+Scene buildScene(const State& st, const Starfield& starfield, const Population* population, EphemerisCache& ephemeris,
+	OrbitCache& orbit_cache)
+{
+	Scene scene;
+	scene.starfield = &starfield;
+	scene.population = population;
+	scene.st = st;
+
+	// get planet positions
+	StateMatrix SolarSystemState = ephemeris.getStates(st.et);
+	// access is StateMatrix[planet idx][pos/vel idx][vector component (x,y,z) idx]
+
+	// convert major body state vectors to J2000 ecliptic version (rather than standard equatorial J2000)
+
+	std::vector<Vec3>& major_pos_eclip = scene.major_pos;
+	std::vector<Vec3>& major_vel_eclip = scene.major_vel;
+
+	for (int idx_major = 0; idx_major < SolarSystemState.size(); idx_major++)
+	{
+		SpiceDouble equ_pos[3] = { SolarSystemState[idx_major][0][0], SolarSystemState[idx_major][0][1], SolarSystemState[idx_major][0][2] };
+		SpiceDouble ecl_pos[3];
+		mxv_c(equ_ecl_rot, equ_pos, ecl_pos);
+
+		SpiceDouble equ_vel[3] = { SolarSystemState[idx_major][1][0], SolarSystemState[idx_major][1][1], SolarSystemState[idx_major][1][2] };
+		SpiceDouble ecl_vel[3];
+		mxv_c(equ_ecl_rot, equ_vel, ecl_vel);
+
+		Vec3 new_pos = Vec3(ecl_pos[0], ecl_pos[1], ecl_pos[2]);
+		Vec3 new_vel = Vec3(ecl_vel[0], ecl_vel[1], ecl_vel[2]);
+		major_pos_eclip.push_back(new_pos);
+		major_vel_eclip.push_back(new_vel);
+	}
+
+	// also convert minor planet state
+	SpiceDouble mp_equ_pos[3] = { st.p.x, st.p.y, st.p.z };
+	SpiceDouble mp_ecl_pos[3];
+	mxv_c(equ_ecl_rot, mp_equ_pos, mp_ecl_pos);
+
+	SpiceDouble mp_equ_vel[3] = { st.v.x, st.v.y, st.v.z };
+	SpiceDouble mp_ecl_vel[3];
+	mxv_c(equ_ecl_rot, mp_equ_vel, mp_ecl_vel);
+
+	scene.mp_pos = Vec3(mp_ecl_pos[0], mp_ecl_pos[1], mp_ecl_pos[2]);
+	scene.mp_vel = Vec3(mp_ecl_vel[0], mp_ecl_vel[1], mp_ecl_vel[2]);
+
+	// get sampled two-body ellipse for the minor planet
+	// the top-down and edge-on cameras depend on it, they are where they would be if the cached one were reused
+	std::vector<Vec3> cam_positions = getCameraPositions(getMapViews(scene, orbit_cache.getCachedLine(0), orbit_cache.fov, orbit_cache.custom_views));
+	orbit_cache.getOrbit(0, getOrbitCurve(scene.mp_pos, scene.mp_vel), cam_positions, scene.mp_curve, scene.mp_orbit);
+	cam_positions = getCameraPositions(getMapViews(scene, scene.mp_orbit, orbit_cache.fov, orbit_cache.custom_views));
+
+	// get them for major bodies too
+	std::vector<Polyline>& major_orbits = scene.major_orbits;
+	major_orbits.resize(SolarSystemState.size());
+	scene.major_curves.resize(SolarSystemState.size());
+	for (int idx_major = 0; idx_major < SolarSystemState.size(); idx_major++)
+	{
+		OrbitCurve curve;
+		if (idx_major < 3) // having vectors relative to Sun instead of the barycenter makes some less wobbly
+		{
+			curve = getOrbitCurve(major_pos_eclip[idx_major] - major_pos_eclip[0], major_vel_eclip[idx_major] - major_vel_eclip[0]);
+		}
+		else
+		{
+			curve = getOrbitCurve(major_pos_eclip[idx_major], major_vel_eclip[idx_major]);
+		}
+		orbit_cache.getOrbit(1 + idx_major, curve, cam_positions, scene.major_curves[idx_major], major_orbits[idx_major]);
+	}
+
+	return scene;
+}
+
+// scene, cam_mode, fov, orbit tessellation, custom views, map_name
+// no SPICE in here, so this can run on any thread
+// everything camera-independent is already in the scene, the views only differ in the projection and raster work,
+// so they are drawn side by side on view_pool (idle render threads pick them up)
+void mapSS3D(ImageWriter& writer, WorkerPool* view_pool, WorkerPool* tile_pool, const Scene& scene,
+	const std::string& cam_mode, double fov_deg, OrbitTessellation tess, const std::vector<ViewSpec>& custom_views,
+	const std::string& map_name, int screen_x, int screen_y, ImageFormat image_format,
+	FrameStream* stream, long long frame_idx)
+{
+	double fov = deg2rad(fov_deg);
+
+	// first set up all the cameras
+	std::vector<RenderView> views = getMapViews(scene, scene.mp_orbit, fov, custom_views);
+
+	// the population moves once per epoch, in blocks on the render threads, and all views share the positions
+	PopulationPoints population_points;
+	if (scene.population)
+	{
+		const Population& population = *scene.population;
+		population_points.x.resize(population.size());
+		population_points.y.resize(population.size());
+		population_points.z.resize(population.size());
+
+		int N_blocks = (population.size() + POPULATION_BLOCK - 1) / POPULATION_BLOCK;
+		std::function<void(int)> propagate_block = [&](int idx_block) {
+			size_t first = (size_t)idx_block * POPULATION_BLOCK;
+			propagatePopulation(population, scene.st.et, population_points, first, min(first + POPULATION_BLOCK, population.size()));
+		};
+
+		if (view_pool)
+		{
+			view_pool->parallelFor(N_blocks, propagate_block);
+		}
+		else
+		{
+			for (int idx_block = 0; idx_block < N_blocks; idx_block++)
+			{
+				propagate_block(idx_block);
+			}
+		}
+	}
+
+	// drop the ones that aren't being streamed
+	std::vector<RenderView> wanted_views;
+	for (int idx_view = 0; idx_view < views.size(); idx_view++)
+	{
+		if (isViewWanted(views[idx_view].name, stream))
+		{
+			wanted_views.push_back(views[idx_view]);
+		}
+	}
+
+	// now we can draw images
+	std::function<void(int)> render_view = [&](int idx_view) {
+		const RenderView& view = wanted_views[idx_view];
+		Camera cam = makeCamera(view.cam_pos, view.cam_orient, fov, screen_x, screen_y);
+		renderSolarSystem(writer, tile_pool, scene, cam_mode, cam, tess, scene.population ? &population_points : nullptr,
+			getViewTarget(view.name, map_name, image_format, stream, frame_idx));
+	};
+
+	if (view_pool)
+	{
+		view_pool->parallelFor(wanted_views.size(), render_view);
+	}
+	else
+	{
+		for (int idx_view = 0; idx_view < wanted_views.size(); idx_view++)
+		{
+			render_view(idx_view);
+		}
+	}
+}
+
+// peak working set of the process so far, in bytes
+size_t getPeakMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return 0;
+	}
+
+	return counters.PeakWorkingSetSize;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// compares the reference single-threaded CSV reader against the parallel one
+void benchCatalog(const std::string& filename)
+{
+	std::cout << "Star catalog ingest benchmark: " << filename << "\n";
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> ref = readTycho2(filename);
+	double t_ref = secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> par = readTycho2Parallel(filename);
+	double t_par = secondsSince(start);
+
+	double N_rows = std::get<0>(ref).size();
+	std::cout << "    Rows: " << (size_t)N_rows << "\n";
+	std::cout << "    readTycho2:         " << t_ref << " s, " << N_rows / t_ref << " rows/s\n";
+	std::cout << "    readTycho2Parallel: " << t_par << " s, " << N_rows / t_par << " rows/s ("
+		<< max(1, (int)std::thread::hardware_concurrency()) << " threads)\n";
+	std::cout << "    Speedup: " << t_ref / t_par << "x\n";
+	std::cout << "    Results identical: " << (ref == par ? "yes" : "NO") << "\n";
+}
+
+// a made-up but plausible scene, so the raster benchmark doesn't need SPICE kernels or a state vector file
+Scene makeBenchmarkScene(const Starfield& starfield)
+{
+	double mu_sun = 1.3271244004193938E+11;
+	std::vector<double> planet_sma = { 57.9e6, 108.2e6, 149.6e6, 227.9e6, 778.5e6, 1432.0e6, 2867.0e6, 4515.0e6 };
+
+	Scene scene;
+	scene.starfield = &starfield;
+	scene.st.datetime = "2025-01-01T00:00:00.000";
+
+	// the Sun wobbles around the barycenter a little
+	scene.major_pos.push_back(Vec3(7e5, 3e5, 0));
+	scene.major_vel.push_back(Vec3(-0.005, 0.012, 0));
+	for (int idx_planet = 0; idx_planet < planet_sma.size(); idx_planet++)
+	{
+		double r = planet_sma[idx_planet];
+		double theta = 0.7 * (idx_planet + 1);
+		double v = sqrt(mu_sun / r) * 1.04; // a little faster than circular, so the orbits are mildly eccentric
+		scene.major_pos.push_back(Vec3(r * cos(theta), r * sin(theta), 0));
+		scene.major_vel.push_back(Vec3(-v * sin(theta), v * cos(theta), 0.02 * v));
+	}
+
+	scene.major_orbits.resize(scene.major_pos.size());
+	scene.major_curves.resize(scene.major_pos.size());
+	for (int idx_major = 0; idx_major < scene.major_pos.size(); idx_major++)
+	{
+		scene.major_curves[idx_major] = getOrbitCurve(scene.major_pos[idx_major], scene.major_vel[idx_major]);
+		sampleKeplerOrbit(scene.major_curves[idx_major], scene.major_orbits[idx_major]);
+	}
+
+	double r_mp = 2.7 * AU;
+	scene.mp_pos = Vec3(r_mp * 0.6, r_mp * 0.8, 0.1 * AU);
+	scene.mp_vel = Vec3(-0.8, 0.6, 0.1) * (sqrt(mu_sun / r_mp) * 1.2);
+	scene.mp_curve = getOrbitCurve(scene.mp_pos, scene.mp_vel);
+	sampleKeplerOrbit(scene.mp_curve, scene.mp_orbit);
+
+	return scene;
+}
+
+// a camera the orbit benchmarks look through, fov in degrees
+struct BenchmarkCamera
+{
+	std::string name;
+	double fov_deg;
+	Camera cam;
+};
+
+// what the orbit benchmarks share: the made-up scene, the cameras to look at it through (from the whole system
+// down to a sliver of Jupiter's neighbourhood) and the orbits to draw, the minor planet's and the planets'
+// the scene points at the starfield next to it, so this is made in place and never copied
+struct OrbitBenchmark
+{
+	int screen_x;
+	int screen_y;
+	Starfield starfield;
+	Scene scene;
+	std::vector<BenchmarkCamera> cameras;
+	std::vector<const Polyline*> orbits;
+	std::vector<const OrbitCurve*> curves; // the orbits' curves, in the same order
+
+	OrbitBenchmark(int screen_x_p, int screen_y_p)
+	{
+		screen_x = screen_x_p;
+		screen_y = screen_y_p;
+		scene = makeBenchmarkScene(starfield);
+
+		addCamera("overview", 60, getCustomView(scene, ViewSpec{ "", deg2rad(45), deg2rad(45), 15 * AU, "SOLAR_SYSTEM_BARYCENTER", "None" }));
+		addCamera("riding Earth, facing the Sun", 90, getCustomView(scene, ViewSpec{ "", 0, 0, 0, "SUN", "EARTH_BARYCENTER" }));
+		addCamera("riding Earth, facing Jupiter", 30, getCustomView(scene, ViewSpec{ "", 0, 0, 0, "JUPITER_BARYCENTER", "EARTH_BARYCENTER" }));
+		addCamera("riding the minor planet, facing Jupiter", 120, getCustomView(scene, ViewSpec{ "", 0, 0, 0, "JUPITER_BARYCENTER", "MP" }));
+		addCamera("riding Jupiter, facing the Sun", 10, getCustomView(scene, ViewSpec{ "", 0, 0, 0, "SUN", "JUPITER_BARYCENTER" }));
+		addCamera("zoom on Earth", 2, getCustomView(scene, ViewSpec{ "", deg2rad(20), deg2rad(10), 1.3 * AU, "EARTH_BARYCENTER", "None" }));
+		addCamera("extreme zoom on Jupiter", 0.01, getCustomView(scene, ViewSpec{ "", deg2rad(60), deg2rad(5), 4 * AU, "JUPITER_BARYCENTER", "None" }));
+
+		orbits.push_back(&scene.mp_orbit);
+		curves.push_back(&scene.mp_curve);
+		for (int idx_major = 1; idx_major < scene.major_orbits.size(); idx_major++)
+		{
+			orbits.push_back(&scene.major_orbits[idx_major]);
+			curves.push_back(&scene.major_curves[idx_major]);
+		}
+	}
+
+	OrbitBenchmark(const OrbitBenchmark&) = delete;
+	OrbitBenchmark& operator=(const OrbitBenchmark&) = delete;
+
+	void addCamera(const std::string& name, double fov_deg, const RenderView& view)
 	{
-		const uint8_t* bitmap = font8x8_basic[(unsigned char)c]; // assuming it's defined
-		drawChar(img, screen_x, screen_y, x, y, bitmap, color);
-		x += 8; // fixed spacing
+		cameras.push_back({ name, fov_deg, makeCamera(view.cam_pos, view.cam_orient, deg2rad(fov_deg), screen_x, screen_y) });
 	}
-}
+};
 
-void drawCircle(std::vector<std::array<int, 3>>& img, int screen_x, int screen_y, int cx, int cy, int radius, std::array<int, 3> color = {255, 255, 255})
+uint64_t hashFramebuffer(const Framebuffer& img)
 {
-	for (int dy = -radius; dy <= radius; ++dy)
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	for (int y = 0; y < img.height; ++y)
 	{
-		for (int dx = -radius; dx <= radius; ++dx)
+		const uint32_t* px = img.row(y);
+		for (int x = 0; x < img.width; ++x)
 		{
-			if (dx * dx + dy * dy <= radius * radius)
-			{
-				int x = cx + dx;
-				int y = cy + dy;
-				if (x >= 0 && x < screen_x && y >= 0 && y < screen_y)
-				{
-					int idx = y * screen_x + x;
-					img[idx] = color;
-				}
-			}
+			hash = (hash ^ px[x]) * 1099511628211ull;
 		}
 	}
+	return hash;
 }
 
-void drawLine(std::vector<std::array<int, 3>>& img, int screen_x, int screen_y,
-	int x0, int y0, int x1, int y1, std::array<int, 3> color)
+// serial vs tile-parallel rasterization of one top-down frame at poster sizes
+void benchRaster(const std::string& starcatalog_path)
 {
-	if (x0 < 0 || y0 < 0 || x1 < 0 || y1 < 0)
+	Starfield starfield;
+	if (strcmp(starcatalog_path.c_str(), "None"))
 	{
-		return;
+		starfield = loadStarCatalog(starcatalog_path, 9);
 	}
+	Scene scene = makeBenchmarkScene(starfield);
 
-	int dx = std::abs(x1 - x0);
-	int dy = -std::abs(y1 - y0);
-	int sx = (x0 < x1) ? 1 : -1;
-	int sy = (y0 < y1) ? 1 : -1;
-	int err = dx + dy; // error value
+	int N_tile_threads = max(2, (int)std::thread::hardware_concurrency());
+	WorkerPool tile_pool(N_tile_threads - 1, 4 * N_tile_threads);
 
-	int iters = 0;
-	const int MAXITERS = max(screen_x, screen_y) * 2;
+	std::cout << "Tile rasterizer benchmark: " << starfield.mags.size() << " stars, " << N_tile_threads << " tile threads\n";
 
-	while (true)
+	double fov = deg2rad(60);
+	Vec3 cam_pos = Vec3(0, 0, 1500e6 / tan(fov / 2));
+	std::vector<Vec3> cam_orient = { Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1) };
+
+	std::vector<std::array<int, 2>> sizes = { {3840, 2160}, {7680, 4320}, {15360, 8640} };
+	Framebuffer img;
+	for (int idx_size = 0; idx_size < sizes.size(); idx_size++)
 	{
-		if (x0 >= 0 && x0 < screen_x && y0 >= 0 && y0 < screen_y)
-		{
-			int idx = y0 * screen_x + x0;
-			img[idx] = color;
-		}
+		int screen_x = sizes[idx_size][0];
+		int screen_y = sizes[idx_size][1];
 
-		if (x0 == x1 && y0 == y1) 
-		{
-			break;
-		}
+		Camera cam = makeCamera(cam_pos, cam_orient, fov, screen_x, screen_y);
 
-		int e2 = 2 * err;
+		// once untimed, so the allocation isn't counted
+		drawSolarSystem(img, nullptr, scene, "p", cam, OrbitTessellation::ADAPTIVE, nullptr);
 
-		if (e2 >= dy)
-		{
-			err += dy;
-			x0 += sx;
-		}
-		if (e2 <= dx)
-		{
-			err += dx;
-			y0 += sy;
-		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		drawSolarSystem(img, nullptr, scene, "p", cam, OrbitTessellation::ADAPTIVE, nullptr);
+		double t_serial = secondsSince(start);
+		uint64_t serial_hash = hashFramebuffer(img);
 
-		iters++;
+		start = std::chrono::steady_clock::now();
+		drawSolarSystem(img, &tile_pool, scene, "p", cam, OrbitTessellation::ADAPTIVE, nullptr);
+		double t_tiled = secondsSince(start);
+		uint64_t tiled_hash = hashFramebuffer(img);
 
-		if (iters > MAXITERS) // failsafe
+		std::cout << "    " << screen_x << "x" << screen_y << ": serial " << t_serial << " s, tiled " << t_tiled << " s, speedup "
+			<< t_serial / t_tiled << "x, identical: " << (serial_hash == tiled_hash ? "yes" : "NO") << "\n";
+	}
+}
+
+int countLitPixels(const Framebuffer& img)
+{
+	int N_lit = 0;
+	for (int y = 0; y < img.height; ++y)
+	{
+		const uint32_t* px = img.row(y);
+		for (int x = 0; x < img.width; ++x)
 		{
-			break;
+			N_lit += (px[x] != packRGB(0, 0, 0));
 		}
 	}
+	return N_lit;
 }
 
-std::vector<Vec3> getKeplerOrbitPoints(Vec3 p, Vec3 v, int N_points = 720)
+// a made-up main belt with a sprinkling of NEOs, about the size of MPCORB
+Population makeBenchmarkPopulation(int N_objects)
 {
-	// returns {sma, eccentricity, inclination, omega, arg_periapsis, true_anomaly, mean_anomaly}
-	std::vector<double> orbital_elems = eclStateVector2Kepler(p, v);
-
-	double a = orbital_elems[0];
-	double e = orbital_elems[1];
-	double i = deg2rad(orbital_elems[2]);
-	double omega = deg2rad(orbital_elems[3]);
-	double arg_periapsis = deg2rad(orbital_elems[4]);
-
-	std::vector<Vec3> orbit_points;
+	Population population;
+	uint64_t rng = 88172645463325252ull;
+	auto uniform = [&rng]() {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		return (rng >> 11) * (1.0 / 9007199254740992.0);
+	};
 
-	if (e < 1)
+	for (int idx_object = 0; idx_object < N_objects; idx_object++)
 	{
-		// use (N_points + 1) points to close the curve
-		for (int k = 0; k < N_points + 1; ++k)
-		{
-			double nu = 2.0 * pi_c() * k / N_points; // true anomaly
+		bool neo = idx_object % 50 == 0;
+		double a = neo ? 0.8 + 1.8 * uniform() : 2.1 + 1.2 * uniform(); // AU
+		double e = neo ? 0.1 + 0.85 * uniform() : 0.3 * uniform();
+		double i = neo ? 40 * uniform() : 25 * uniform();
+		double n = rad2deg(sqrt(1.3271244004193938E+11 / pow(a * AU, 3))) * 86400; // deg/day
+		population.addElements(a * AU, e, i, 360 * uniform(), 360 * uniform(), 360 * uniform(), n, 86400 * 365.25 * 25 * uniform());
+	}
 
-			// Compute radius in orbital plane
-			double r = a * (1 - e * e) / (1 + e * cos(nu));
-			double x_orb = r * cos(nu);
-			double y_orb = r * sin(nu);
-			double z_orb = 0;
+	return population;
+}
 
-			// orbital transformation
-			double cos_o = cos(omega);
-			double sin_o = sin(omega);
-			double cos_i = cos(i);
-			double sin_i = sin(i);
-			double cos_w = cos(arg_periapsis);
-			double sin_w = sin(arg_periapsis);
+// the population layer: SSE2 Kepler solver against libm and plain Newton, then projection and splatting at 1080p and
+// 4K, serial and on the tile threads
+void benchPopulation()
+{
+	const int N_objects = 1300000;
+	Population population = makeBenchmarkPopulation(N_objects);
+	double et = 86400 * 365.25 * 26; // 2026
 
-			// position in orbital plane
-			double x1 = cos_w * x_orb - sin_w * y_orb;
-			double y1 = sin_w * x_orb + cos_w * y_orb;
-			double z1 = 0;
+	int N_threads = max(2, (int)std::thread::hardware_concurrency());
+	WorkerPool pool(N_threads - 1, 4 * N_threads);
+	int N_blocks = (N_objects + POPULATION_BLOCK - 1) / POPULATION_BLOCK;
 
-			// rotate by inclination
-			double x2 = x1;
-			double y2 = cos_i * y1;
-			double z2 = sin_i * y1;
+	std::cout << "Population benchmark: " << N_objects << " objects, " << N_threads << " threads\n";
 
-			// rotate by longitude of ascending node
-			double x = cos_o * x2 - sin_o * y2;
-			double y = sin_o * x2 + cos_o * y2;
-			double z = z2;
+	PopulationPoints points;
+	points.x.resize(N_objects);
+	points.y.resize(N_objects);
+	points.z.resize(N_objects);
 
-			orbit_points.push_back(Vec3(x, y, z));
-		}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int idx_object = 0; idx_object < N_objects; idx_object++)
+	{
+		Vec3 pos = propagatePopulationObject(population, idx_object, et);
+		points.x[idx_object] = pos.x;
+		points.y[idx_object] = pos.y;
+		points.z[idx_object] = pos.z;
 	}
-	else // para- or hyperbolic orbit, only render around periapsis
+	double t_ref = secondsSince(start);
+	PopulationPoints ref_points = points;
+
+	start = std::chrono::steady_clock::now();
+	propagatePopulation(population, et, points, 0, N_objects);
+	double t_sse = secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	pool.parallelFor(N_blocks, [&](int idx_block) {
+		size_t first = (size_t)idx_block * POPULATION_BLOCK;
+		propagatePopulation(population, et, points, first, min(first + POPULATION_BLOCK, (size_t)N_objects));
+	});
+	double t_parallel = secondsSince(start);
+
+	double max_deviation = 0;
+	for (int idx_object = 0; idx_object < N_objects; idx_object++)
 	{
-		// no need to close an open curve
-		for (int k = 0; k < N_points; ++k)
-		{
-			double nu = deg2rad(-85.0) + deg2rad(170.0) * k / (N_points - 1); // true anomaly
-
-			// Compute radius in orbital plane
-			double r = a * (1 - e * e) / (1 + e * cos(nu));
-			double x_orb = r * cos(nu);
-			double y_orb = r * sin(nu);
-			double z_orb = 0;
-
-			// orbital transformation
-			double cos_o = cos(omega);
-			double sin_o = sin(omega);
-			double cos_i = cos(i);
-			double sin_i = sin(i);
-			double cos_w = cos(arg_periapsis);
-			double sin_w = sin(arg_periapsis);
+		Vec3 diff = Vec3(points.x[idx_object], points.y[idx_object], points.z[idx_object])
+			- Vec3(ref_points.x[idx_object], ref_points.y[idx_object], ref_points.z[idx_object]);
+		max_deviation = max(max_deviation, diff.mag());
+	}
 
-			// position in orbital plane
-			double x1 = cos_w * x_orb - sin_w * y_orb;
-			double y1 = sin_w * x_orb + cos_w * y_orb;
-			double z1 = 0;
+	std::cout << "    propagation, libm:     " << t_ref * 1e3 << " ms\n";
+	std::cout << "    propagation, SSE2:     " << t_sse * 1e3 << " ms, speedup " << t_ref / t_sse << "x\n";
+	std::cout << "    propagation, parallel: " << t_parallel * 1e3 << " ms\n";
+	std::cout << "    largest deviation from libm: " << max_deviation << " km\n";
 
-			// rotate by inclination
-			double x2 = x1;
-			double y2 = cos_i * y1;
-			double z2 = sin_i * y1;
+	Starfield starfield;
+	Scene scene = makeBenchmarkScene(starfield);
+	scene.population = &population;
 
-			// rotate by longitude of ascending node
-			double x = cos_o * x2 - sin_o * y2;
-			double y = sin_o * x2 + cos_o * y2;
-			double z = z2;
+	double fov = deg2rad(60);
+	Vec3 cam_pos = Vec3(0, 0, 1.33 * 816.4e6 / tan(fov / 2)); // where the top-down view would be for a main belt object
+	std::vector<Vec3> cam_orient = { Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1) };
 
-			orbit_points.push_back(Vec3(x, y, z));
-		}
+	std::vector<std::array<int, 2>> sizes = { {1920, 1080}, {3840, 2160} };
+	Framebuffer img;
+	for (int idx_size = 0; idx_size < sizes.size(); idx_size++)
+	{
+		Camera cam = makeCamera(cam_pos, cam_orient, fov, sizes[idx_size][0], sizes[idx_size][1]);
+
+		drawSolarSystem(img, nullptr, scene, "p", cam, OrbitTessellation::ADAPTIVE, nullptr);
+		start = std::chrono::steady_clock::now();
+		drawSolarSystem(img, nullptr, scene, "p", cam, OrbitTessellation::ADAPTIVE, nullptr);
+		double t_none = secondsSince(start);
+
+		drawSolarSystem(img, nullptr, scene, "p", cam, OrbitTessellation::ADAPTIVE, &points);
+		start = std::chrono::steady_clock::now();
+		drawSolarSystem(img, nullptr, scene, "p", cam, OrbitTessellation::ADAPTIVE, &points);
+		double t_serial = secondsSince(start);
+		uint64_t serial_hash = hashFramebuffer(img);
+		int N_lit = countLitPixels(img);
+
+		start = std::chrono::steady_clock::now();
+		drawSolarSystem(img, &pool, scene, "p", cam, OrbitTessellation::ADAPTIVE, &points);
+		double t_tiled = secondsSince(start);
+		uint64_t tiled_hash = hashFramebuffer(img);
+
+		// a frame is one propagation plus one view
+		std::cout << "    " << sizes[idx_size][0] << "x" << sizes[idx_size][1] << ": without population " << t_none * 1e3
+			<< " ms, with it " << t_serial * 1e3 << " ms serial, " << t_tiled * 1e3 << " ms on the tile threads ("
+			<< 1 / (t_parallel + t_tiled) << " frames/s with propagation), " << N_lit << " lit pixels, identical: "
+			<< (serial_hash == tiled_hash ? "yes" : "NO") << "\n";
 	}
-
-	return orbit_points;
 }
 
-std::vector<int> space2screen(Vec3 pos, Vec3 cam_pos, std::vector<Vec3> cam_orient, double f, int screen_x, int screen_y)
+// orbit lines only, the old unclipped drawLine against near-plane + Liang-Barsky clipping, from ordinary to silly zoom
+void benchLines()
 {
-	// OpenGL-esque
-	Vec3 cam_right = cam_orient[0];
-	Vec3 cam_up = cam_orient[1];
-	Vec3 cam_forward = -cam_orient[2];
+	OrbitBenchmark bench(1920, 1080);
 
-	Vec3 rel_pos = pos - cam_pos;
+	std::cout << "Orbit line clipping benchmark: " << bench.orbits.size() << " orbits, " << bench.screen_x << "x" << bench.screen_y << "\n";
 
-	if (rel_pos.dot(cam_forward) < 0)
+	Framebuffer img;
+	img.resize(bench.screen_x, bench.screen_y);
+	ClipRect full = getFullClipRect(img);
+	ScreenPoints points;
+	const int N_repeats = 20;
+
+	for (int idx_camera = 0; idx_camera < bench.cameras.size(); idx_camera++)
 	{
-		return { -1, -1 };
-	}
+		const Camera& cam = bench.cameras[idx_camera].cam;
+
+		// the old way: truncated pixel coordinates straight into the unclipped line drawing
+		int N_ref_segments = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
+		{
+			img.clear(packRGB(0, 0, 0));
+			N_ref_segments = 0;
+			for (int idx_orbit = 0; idx_orbit < bench.orbits.size(); idx_orbit++)
+			{
+				projectPolyline(cam, *bench.orbits[idx_orbit], points);
+				for (int idx_op = 0; idx_op + 1 < (int)points.x.size(); idx_op++)
+				{
+					if (points.x[idx_op] >= 0 && points.y[idx_op] >= 0 && points.x[idx_op + 1] >= 0 && points.y[idx_op + 1] >= 0)
+					{
+						N_ref_segments++; // the rest are dropped on the spot
+					}
+					drawLineReference(img, points.x[idx_op], points.y[idx_op], points.x[idx_op + 1], points.y[idx_op + 1], packRGB(255, 255, 255));
+				}
+			}
+		}
+		double t_ref = secondsSince(start) / N_repeats;
+		int N_ref_lit = countLitPixels(img);
 
-	double px = f * rel_pos.dot(cam_right) / rel_pos.dot(cam_forward);
-	double py = f * rel_pos.dot(cam_up) / rel_pos.dot(cam_forward);
+		// clipped
+		DisplayList list;
+		start = std::chrono::steady_clock::now();
+		for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
+		{
+			img.clear(packRGB(0, 0, 0));
+			list.commands.clear();
+			for (int idx_orbit = 0; idx_orbit < bench.orbits.size(); idx_orbit++)
+			{
+				projectPolyline(cam, *bench.orbits[idx_orbit], points);
+				addPolyline(list, cam, *bench.orbits[idx_orbit], points, packRGB(255, 255, 255));
+			}
 
-	int pix_x = screen_x / 2 + px + 0.5;
-	int pix_y = screen_y / 2 - py + 0.5;
+			for (int idx_cmd = 0; idx_cmd < list.commands.size(); idx_cmd++)
+			{
+				drawCommand(img, full, list.commands[idx_cmd]);
+			}
+		}
+		double t_clip = secondsSince(start) / N_repeats;
+		int N_clip_lit = countLitPixels(img);
 
-	return std::vector<int> {pix_x, pix_y};
+		std::cout << "    " << bench.cameras[idx_camera].name << " (fov " << bench.cameras[idx_camera].fov_deg << " deg):\n";
+		std::cout << "        unclipped: " << t_ref * 1000 << " ms, " << N_ref_segments << " segments walked, " << N_ref_lit << " pixels lit\n";
+		std::cout << "        clipped:   " << t_clip * 1000 << " ms, " << list.commands.size() << " segments walked, " << N_clip_lit << " pixels lit\n";
+	}
 }
 
-// render a single individual image
-void renderSolarSystem(State st, Vec3 mp_pos, std::vector<Vec3> mp_orbit,
-	std::vector<Vec3> major_pos, std::vector<std::vector<Vec3>> major_orbits,
-	std::string cam_mode, double fov, int screen_x, int screen_y,
-	Vec3 cam_pos, std::vector<Vec3> cam_orient,
-	std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> starfield,
-	std::string save_name)
+// the largest gap on screen between the curve and the chords through the given true anomalies, in pixels
+// only chords whose middle is on screen and in front of the camera count
+double measureFaceting(const Camera& cam, const OrbitCurve& curve, const std::vector<double>& nus)
 {
-	std::vector<std::array<int, 3>> img(screen_x * screen_y, { 0, 0, 0 });
-	int screen_short = min(screen_x, screen_y);
-
-	std::string screen_short_dir = "y";
-	if (screen_short == screen_x)
+	double max_error = 0;
+	for (int idx_nu = 0; idx_nu + 1 < nus.size(); idx_nu++)
 	{
-		screen_short_dir = "x";
-	}
+		double ax, ay, bx, by, mx, my;
+		double depth_a = projectToScreen(cam, getOrbitPoint(curve, nus[idx_nu]), ax, ay);
+		double depth_b = projectToScreen(cam, getOrbitPoint(curve, nus[idx_nu + 1]), bx, by);
+		double depth_m = projectToScreen(cam, getOrbitPoint(curve, 0.5 * (nus[idx_nu] + nus[idx_nu + 1])), mx, my);
+		if (depth_a < NEAR_CLIP_DIST || depth_b < NEAR_CLIP_DIST || depth_m < NEAR_CLIP_DIST
+			|| mx < 0 || my < 0 || mx >= cam.screen_x || my >= cam.screen_y)
+		{
+			continue;
+		}
 
-	// perspective offset factor
-	double f = screen_y / (2 * tan(fov / 2));
-	if (!strcmp(screen_short_dir.c_str(), "x"))
-	{
-		f = screen_x / (2 * tan(fov / 2));
+		// distance from the projected middle of the arc to the projected chord
+		double dx = bx - ax;
+		double dy = by - ay;
+		double len = sqrt(dx * dx + dy * dy);
+		double error = len > 0 ? std::abs((mx - ax) * dy - (my - ay) * dx) / len : sqrt((mx - ax) * (mx - ax) + (my - ay) * (my - ay));
+		max_error = max(max_error, error);
 	}
+	return max_error;
+}
 
-	// OpenGL-esque
-	Vec3 cam_right = cam_orient[0];
-	Vec3 cam_up = cam_orient[1];
-	Vec3 cam_forward = -cam_orient[2];
-
-	// now, we render things from back to front as basic renderers do
-	// so...
-	// draw starfield first
-	SpiceDouble et;
-	utc2et_c(st.datetime.c_str(), &et);
-
-	// gotta get star coordinates in ecliptic now
-	double equ_ecl_rot[3][3];
-	pxform_c("J2000", "ECLIPJ2000", et, equ_ecl_rot);
+// fixed 720-point orbits against per-camera adaptive tessellation at 4K: segment counts, worst faceting and time
+void benchTessellation()
+{
+	OrbitBenchmark bench(3840, 2160);
+	const Scene& scene = bench.scene;
 
-	for (int idx_star = 0; idx_star < std::get<0>(starfield).size(); idx_star++)
+	// a little above a body and looking where it is going, its own orbit sweeps from right under the camera into the distance
+	std::vector<std::array<Vec3, 2>> prograde = { { scene.major_pos[3], scene.major_vel[3] }, { scene.mp_pos, scene.mp_vel } };
+	std::vector<std::string> prograde_names = { "above Earth, looking ahead", "above the minor planet, looking ahead" };
+	for (int idx_body = 0; idx_body < prograde.size(); idx_body++)
 	{
-		if (std::get<0>(starfield)[idx_star] > 6) // don't draw too dim stars, clutters the background
-		{
-			continue;
-		}
-
-		double radius = 1; // normally in EVIS we have a mag2radius but we don't really need that here
-		double RA = std::get<1>(starfield)[idx_star];
-		double DEC = std::get<2>(starfield)[idx_star];
+		Vec3 forward = prograde[idx_body][1].normalized();
+		Vec3 right = forward.cross(Vec3(0, 0, 1)).normalized();
+		Vec3 up = right.cross(forward).normalized();
+		std::vector<Vec3> cam_orient = { right, up, -forward };
+		bench.addCamera(prograde_names[idx_body], 60, RenderView{ "", prograde[idx_body][0] + up * (0.002 * AU), cam_orient });
+	}
 
-		// assign a 3D vector to the star at pseudo-infinite distance
-		Vec3 star_pos_equ = Vec3(RA, DEC); // in case of doubt, yes, this takes RA and DEC in degrees
-		
-		SpiceDouble star_pos_equ_dbl[3] = { star_pos_equ.x, star_pos_equ.y, star_pos_equ.z };
-		SpiceDouble star_pos_ecl_dbl[3];
-		mxv_c(equ_ecl_rot, star_pos_equ_dbl, star_pos_ecl_dbl);
+	std::cout << "Orbit tessellation benchmark: " << bench.orbits.size() << " orbits, " << bench.screen_x << "x" << bench.screen_y
+		<< ", tolerance " << TESS_TOLERANCE_PX << " px\n";
 
-		Vec3 star_pos = Vec3(star_pos_ecl_dbl[0], star_pos_ecl_dbl[1], star_pos_ecl_dbl[2]);
+	OrbitScratch scratch;
+	const int N_repeats = 50;
 
-		// do not do this! no need! star is at infinite distance anyway!!
-		// Vec3 star_rel_pos = star_pos - cam_pos;
+	for (int idx_camera = 0; idx_camera < bench.cameras.size(); idx_camera++)
+	{
+		const Camera& cam = bench.cameras[idx_camera].cam;
+		Frustum frustum = makeFrustum(cam);
 
-		if (star_pos.dot(cam_forward) > 0)
+		std::cout << "    " << bench.cameras[idx_camera].name << " (fov " << bench.cameras[idx_camera].fov_deg << " deg):\n";
+		for (int idx_mode = 0; idx_mode < 2; idx_mode++)
 		{
-			double px = f * star_pos.dot(cam_right) / star_pos.dot(cam_forward);
-			double py = f * star_pos.dot(cam_up) / star_pos.dot(cam_forward);
+			OrbitTessellation tess = idx_mode == 0 ? OrbitTessellation::FIXED : OrbitTessellation::ADAPTIVE;
+
+			DisplayList list;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
+			{
+				list.commands.clear();
+				for (int idx_orbit = 0; idx_orbit < bench.orbits.size(); idx_orbit++)
+				{
+					addOrbit(list, cam, frustum, *bench.orbits[idx_orbit], *bench.curves[idx_orbit], tess, scratch, packRGB(255, 255, 255));
+				}
+			}
+			double t_list = secondsSince(start) / N_repeats;
 
-			int pix_x = screen_x / 2 + px + 0.5;
-			int pix_y = screen_y / 2 - py + 0.5;
+			// segment counts and faceting, once more without timing
+			long long N_segments = 0;
+			double max_error = 0;
+			for (int idx_orbit = 0; idx_orbit < bench.orbits.size(); idx_orbit++)
+			{
+				const OrbitCurve& curve = *bench.curves[idx_orbit];
+				if (tess == OrbitTessellation::ADAPTIVE)
+				{
+					tessellateOrbit(cam, frustum, curve, scratch.line, scratch.nus);
+				}
+				else
+				{
+					int N_samples = bench.orbits[idx_orbit]->size();
+					scratch.nus.resize(N_samples);
+					for (int k = 0; k < N_samples; k++)
+					{
+						scratch.nus[k] = curve.nu_start + (curve.nu_end - curve.nu_start) / (N_samples - 1) * k;
+					}
+				}
+				N_segments += scratch.nus.size() - 1;
+				max_error = max(max_error, measureFaceting(cam, curve, scratch.nus));
+			}
 
-			drawCircle(img, screen_x, screen_y, pix_x, pix_y, radius, {200, 200, 200});
+			std::cout << "        " << (tess == OrbitTessellation::FIXED ? "fixed:    " : "adaptive: ") << N_segments << " segments, "
+				<< list.commands.size() << " drawn, worst chord " << max_error << " px off, " << t_list * 1e6 << " us\n";
 		}
 	}
+}
 
-	// ok, next thing, orbit ellipses!
-	// minor planet orbit first
-	//                                            vvv -- there is one less line than there are points
-	for (int idx_op = 0; idx_op < mp_orbit.size() - 1; idx_op++)
-	{
-		Vec3 p1 = mp_orbit[idx_op];
-		Vec3 p2 = mp_orbit[idx_op + 1];
-
-		std::vector<int> p1_scrpos = space2screen(p1, cam_pos, cam_orient, f, screen_x, screen_y);
-		std::vector<int> p2_scrpos = space2screen(p2, cam_pos, cam_orient, f, screen_x, screen_y);
+// the batched orbit sampler against the old per-sample one, in samples per second, plus how far apart their points are
+void benchOrbits()
+{
+	double mu_sun = 1.3271244004193938E+11;
 
-		drawLine(img, screen_x, screen_y, p1_scrpos[0], p1_scrpos[1], p2_scrpos[0], p2_scrpos[1], { 0, 255, 0 });
+	// a spread of states around the Sun: near-circular planets, eccentric and inclined minor planets, and flybys
+	std::vector<std::array<Vec3, 2>> states;
+	for (int idx_state = 0; idx_state < 64; idx_state++)
+	{
+		double r = (0.4 + 0.5 * idx_state) * AU;
+		double theta = 0.37 * idx_state;
+		double speed_factor = idx_state % 8 == 7 ? 1.6 : 0.8 + 0.05 * (idx_state % 8); // every eighth one is hyperbolic
+		double v = sqrt(mu_sun / r) * speed_factor;
+		double tilt = 0.05 * (idx_state % 5);
+		states.push_back({ Vec3(r * cos(theta), r * sin(theta), 0.01 * r), Vec3(-v * sin(theta), v * cos(theta), tilt * v) });
 	}
 
-	// now the orbits of major planets (Sun orbit is not drawn, therefore index starts at 1)
-	for (int idx_major = 1; idx_major < major_orbits.size(); idx_major++)
+	const int N_points = 720;
+	const int N_repeats = 50;
+	std::cout << "Orbit sampler benchmark: " << states.size() << " orbits, " << N_points << " points each\n";
+
+	long long N_samples = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 	{
-		for (int idx_op = 0; idx_op < major_orbits[idx_major].size() - 1; idx_op++)
+		for (int idx_state = 0; idx_state < states.size(); idx_state++)
 		{
-			Vec3 p1 = major_orbits[idx_major][idx_op];
-			Vec3 p2 = major_orbits[idx_major][idx_op + 1];
-
-			std::vector<int> p1_scrpos = space2screen(p1, cam_pos, cam_orient, f, screen_x, screen_y);
-			std::vector<int> p2_scrpos = space2screen(p2, cam_pos, cam_orient, f, screen_x, screen_y);
-
-			drawLine(img, screen_x, screen_y, p1_scrpos[0], p1_scrpos[1], p2_scrpos[0], p2_scrpos[1], major_body_colors[idx_major]);
+			N_samples += getKeplerOrbitPointsReference(states[idx_state][0], states[idx_state][1], N_points).size();
 		}
 	}
+	double t_ref = secondsSince(start);
 
-	// now draw the objects themselves
-	// starting with the minor planet...
-	std::vector<int> mp_scrpos = space2screen(mp_pos, cam_pos, cam_orient, f, screen_x, screen_y);
-	if (!(mp_scrpos[0] == -1 && mp_scrpos[1] == -1))
+	Polyline line; // reused, like a scene rebuilt every epoch would
+	start = std::chrono::steady_clock::now();
+	for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 	{
-		drawCircle(img, screen_x, screen_y, mp_scrpos[0], mp_scrpos[1], 3);
+		for (int idx_state = 0; idx_state < states.size(); idx_state++)
+		{
+			sampleKeplerOrbit(getOrbitCurve(states[idx_state][0], states[idx_state][1]), line, N_points);
+		}
 	}
+	double t_batched = secondsSince(start);
 
-	// now the major bodies (this time including the Sun, of course)
-	for (int idx_major = 0; idx_major < major_orbits.size(); idx_major++)
+	// deviation relative to the periapsis distance, the scale at which the orbit gets looked at
+	double max_rel_error = 0;
+	for (int idx_state = 0; idx_state < states.size(); idx_state++)
 	{
-		std::vector<int> mp_scrpos = space2screen(major_pos[idx_major], cam_pos, cam_orient, f, screen_x, screen_y);
-		if (idx_major == 0)
+		std::vector<Vec3> ref_points = getKeplerOrbitPointsReference(states[idx_state][0], states[idx_state][1], N_points);
+		sampleKeplerOrbit(getOrbitCurve(states[idx_state][0], states[idx_state][1]), line, N_points);
+
+		double r_min = ref_points[0].mag();
+		for (int idx_point = 0; idx_point < ref_points.size(); idx_point++)
 		{
-			// compute real angular size in pixels
-			double ang_radius = asin(major_body_radii[idx_major] / (major_pos[idx_major] - cam_pos).mag());
-			double pix_radius = f * tan(ang_radius);
-			double draw_radius = max(5, pix_radius);
-			drawCircle(img, screen_x, screen_y, mp_scrpos[0], mp_scrpos[1], draw_radius, major_body_colors[idx_major]);
+			r_min = min(r_min, ref_points[idx_point].mag());
 		}
-		else
+		for (int idx_point = 0; idx_point < ref_points.size(); idx_point++)
 		{
-			double ang_radius = asin(major_body_radii[idx_major] / (major_pos[idx_major] - cam_pos).mag());
-			double pix_radius = f * tan(ang_radius);
-			double draw_radius = max(3, pix_radius);
-			drawCircle(img, screen_x, screen_y, mp_scrpos[0], mp_scrpos[1], draw_radius, major_body_colors[idx_major]);
+			Vec3 diff = ref_points[idx_point] - Vec3(line.x[idx_point], line.y[idx_point], line.z[idx_point]);
+			max_rel_error = max(max_rel_error, diff.mag() / r_min);
 		}
 	}
 
-	drawText(img, screen_x, screen_y, 10, 10, st.datetime, { 255, 0, 0 });
+	std::cout << "    per sample: " << N_samples / t_ref / 1e6 << " M samples/s\n";
+	std::cout << "    batched:    " << N_samples / t_batched / 1e6 << " M samples/s, speedup " << t_ref / t_batched << "x\n";
+	std::cout << "    largest deviation: " << max_rel_error << " of the periapsis distance\n";
+}
+
+// state vectors to Keplerian elements: eclStateVector2Kepler() one state at a time, getKeplerElements() and the
+// batched version over a whole list, checked against each other element by element
+void benchElements()
+{
+	double mu_sun = 1.3271244004193938E+11;
 
-	// now save it to file
-	std::string outfilename = save_name;
-	std::ofstream outfile(outfilename);
+	// a mixed bag like an object list would be: eccentric and inclined, retrograde, hyperbolic and a few lying
+	// exactly in the ecliptic (no ascending node)
+	const int N_states = 8192;
+	StateVectorBatch states;
+	for (int idx_state = 0; idx_state < N_states; idx_state++)
+	{
+		double r = (0.3 + 0.011 * (idx_state % 3001)) * AU;
+		double theta = 0.37 * idx_state;
+		double speed_factor = 0.3 + 1.2 * ((idx_state * 7919) % 1000) / 1000.0; // escape speed is at 1.41
+		double v = sqrt(mu_sun / r) * speed_factor;
+		double tilt = idx_state % 16 == 0 ? 0 : 0.9 * sin(0.13 * idx_state);
+		double flight_path = 0.4 * sin(0.07 * idx_state);
+
+		states.x.push_back(r * cos(theta));
+		states.y.push_back(r * sin(theta));
+		states.z.push_back(idx_state % 16 == 0 ? 0 : 0.02 * r * cos(0.11 * idx_state));
+		states.vx.push_back(v * (-sin(theta) * cos(tilt) + cos(theta) * flight_path));
+		states.vy.push_back(v * (cos(theta) * cos(tilt) + sin(theta) * flight_path));
+		states.vz.push_back(v * sin(tilt));
+	}
 
-	outfile << "P3\n" << screen_x << " " << screen_y << "\n255\n";
+	const int N_repeats = 20;
+	std::cout << "Orbital elements benchmark: " << N_states << " state vectors\n";
 
-	for (int y = 0; y < screen_y; ++y)
+	double checksum = 0; // keeps the reference loop from being optimized away
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 	{
-		for (int x = 0; x < screen_x; ++x)
+		for (int idx_state = 0; idx_state < N_states; idx_state++)
 		{
-			std::array<int, 3> color = img[y * screen_x + x];
-			outfile << color[0] << " " << color[1] << " " << color[2] << " ";
+			checksum += eclStateVector2Kepler(Vec3(states.x[idx_state], states.y[idx_state], states.z[idx_state]),
+				Vec3(states.vx[idx_state], states.vy[idx_state], states.vz[idx_state]))[6];
 		}
-		outfile << "\n";
 	}
+	double t_ref = secondsSince(start);
 
-	outfile.close();
-}
-
-// don't ask
-double getNextLargerOrRetain(double value, const std::vector<double>& sorted_arr)
-{
-	std::vector<double>::const_iterator it = std::upper_bound(sorted_arr.begin(), sorted_arr.end(), value);
-
-	if (it != sorted_arr.end())
+	start = std::chrono::steady_clock::now();
+	for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 	{
-		return *it;
+		for (int idx_state = 0; idx_state < N_states; idx_state++)
+		{
+			checksum += getKeplerElements(Vec3(states.x[idx_state], states.y[idx_state], states.z[idx_state]),
+				Vec3(states.vx[idx_state], states.vy[idx_state], states.vz[idx_state])).mean_anomaly;
+		}
 	}
-	else
+	double t_struct = secondsSince(start);
+
+	KeplerElementsBatch batch; // reused, like it would be for every epoch
+	start = std::chrono::steady_clock::now();
+	for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 	{
-		return value;
+		getKeplerElementsBatch(states, batch);
+		checksum += batch.mean_anomaly[idx_repeat];
 	}
-}
-
-// s, starfield, cam_mode, cam_dist, cam_theta, cam_phi, fov, map_name
-void mapSS3D(State st, std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> starfield,
-	std::string cam_mode, double cam_dist, double cam_theta, double cam_phi, double fov_deg,
-	std::string center_obj, std::string carrier_obj,
-	std::string map_name, int screen_x, int screen_y)
-{
-	double fov = deg2rad(fov_deg);
-
-	SpiceDouble et;
-	utc2et_c(st.datetime.c_str(), &et);
-
-	// get planet positions
-	StateMatrix SolarSystemState = getSolarSystemStates(et);
-	// access is StateMatrix[planet idx][pos/vel idx][vector component (x,y,z) idx]
-
-	// convert major body state vectors to J2000 ecliptic version (rather than standard equatorial J2000)
-	SpiceDouble rotate[3][3];
-	pxform_c("J2000", "ECLIPJ2000", et, rotate);
-
-	std::vector<Vec3> major_pos_eclip;
-	std::vector<Vec3> major_vel_eclip;
-
-	for (int idx_major = 0; idx_major < SolarSystemState.size(); idx_major++)
+	double t_batch = secondsSince(start);
+
+	// relative error per element, against the reference's magnitude (absolute where that is 0)
+	const char* elem_names[7] = { "sma", "e", "inclination", "omega", "arg_periapsis", "true_anomaly", "mean_anomaly" };
+	const std::vector<double>* batch_elems[7] = { &batch.sma, &batch.e, &batch.inclination, &batch.omega, &batch.arg_periapsis,
+		&batch.true_anomaly, &batch.mean_anomaly };
+	double max_rel_error[7] = {};
+	int N_hyperbolic = 0;
+	for (int idx_state = 0; idx_state < N_states; idx_state++)
 	{
-		SpiceDouble equ_pos[3] = { SolarSystemState[idx_major][0][0], SolarSystemState[idx_major][0][1], SolarSystemState[idx_major][0][2] };
-		SpiceDouble ecl_pos[3];
-		mxv_c(rotate, equ_pos, ecl_pos);
-
-		SpiceDouble equ_vel[3] = { SolarSystemState[idx_major][1][0], SolarSystemState[idx_major][1][1], SolarSystemState[idx_major][1][2] };
-		SpiceDouble ecl_vel[3];
-		mxv_c(rotate, equ_vel, ecl_vel);
+		std::vector<double> ref = eclStateVector2Kepler(Vec3(states.x[idx_state], states.y[idx_state], states.z[idx_state]),
+			Vec3(states.vx[idx_state], states.vy[idx_state], states.vz[idx_state]));
+		N_hyperbolic += ref[1] > 1;
 
-		Vec3 new_pos = Vec3(ecl_pos[0], ecl_pos[1], ecl_pos[2]);
-		Vec3 new_vel = Vec3(ecl_vel[0], ecl_vel[1], ecl_vel[2]);
-		major_pos_eclip.push_back(new_pos);
-		major_vel_eclip.push_back(new_vel);
+		for (int idx_elem = 0; idx_elem < 7; idx_elem++)
+		{
+			double diff = abs((*batch_elems[idx_elem])[idx_state] - ref[idx_elem]);
+			max_rel_error[idx_elem] = max(max_rel_error[idx_elem], ref[idx_elem] != 0 ? diff / abs(ref[idx_elem]) : diff);
+		}
 	}
 
-	// also convert minor planet state
-	SpiceDouble mp_equ_pos[3] = { st.p.x, st.p.y, st.p.z };
-	SpiceDouble mp_ecl_pos[3];
-	mxv_c(rotate, mp_equ_pos, mp_ecl_pos);
+	double worst = 0;
+	std::cout << "    (" << N_hyperbolic << " hyperbolic, checksum " << checksum << ")\n";
+	std::cout << "    eclStateVector2Kepler: " << N_states * N_repeats / t_ref / 1e6 << " M states/s\n";
+	std::cout << "    getKeplerElements:     " << N_states * N_repeats / t_struct / 1e6 << " M states/s, speedup " << t_ref / t_struct << "x\n";
+	std::cout << "    batched:               " << N_states * N_repeats / t_batch / 1e6 << " M states/s, speedup " << t_ref / t_batch << "x\n";
+	std::cout << "    largest relative error against eclStateVector2Kepler:\n";
+	for (int idx_elem = 0; idx_elem < 7; idx_elem++)
+	{
+		std::cout << "        " << elem_names[idx_elem] << ": " << max_rel_error[idx_elem] << "\n";
+		worst = max(worst, max_rel_error[idx_elem]);
+	}
+	std::cout << "    within 1e-12: " << (worst <= 1e-12 ? "yes" : "NO") << "\n";
+}
 
-	SpiceDouble mp_equ_vel[3] = { st.v.x, st.v.y, st.v.z };
-	SpiceDouble mp_ecl_vel[3];
-	mxv_c(rotate, mp_equ_vel, mp_ecl_vel);
+// orbit chunks culled against the frustum before projection, against projecting every point, mostly close-up carrier views
+void benchCulling()
+{
+	OrbitBenchmark bench(1920, 1080);
 
-	Vec3 mp_pos = Vec3(mp_ecl_pos[0], mp_ecl_pos[1], mp_ecl_pos[2]);
-	Vec3 mp_vel = Vec3(mp_ecl_vel[0], mp_ecl_vel[1], mp_ecl_vel[2]);
+	std::cout << "Orbit culling benchmark: " << bench.orbits.size() << " orbits, " << POLYLINE_CHUNKS << " chunks each, "
+		<< bench.screen_x << "x" << bench.screen_y << "\n";
 
-	// get sampled two-body ellipse for the minor planet
-	std::vector<Vec3> mp_orbit = getKeplerOrbitPoints(mp_pos, mp_vel);
+	Framebuffer img;
+	img.resize(bench.screen_x, bench.screen_y);
+	ScreenPoints points;
+	const int N_repeats = 200;
 
-	// get them for major bodies too
-	std::vector<std::vector<Vec3>> major_orbits;
-	for (int idx_major = 0; idx_major < SolarSystemState.size(); idx_major++)
+	for (int idx_camera = 0; idx_camera < bench.cameras.size(); idx_camera++)
 	{
-		if (idx_major < 3) // having vectors relative to Sun instead of the barycenter makes some less wobbly
+		const Camera& cam = bench.cameras[idx_camera].cam;
+
+		// display list building only, that is the part culling saves on
+		DisplayList all_list;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 		{
-			major_orbits.push_back(getKeplerOrbitPoints(major_pos_eclip[idx_major] - major_pos_eclip[0], major_vel_eclip[idx_major] - major_vel_eclip[0]));
+			all_list.commands.clear();
+			for (int idx_orbit = 0; idx_orbit < bench.orbits.size(); idx_orbit++)
+			{
+				projectPolyline(cam, *bench.orbits[idx_orbit], points);
+				addPolyline(all_list, cam, *bench.orbits[idx_orbit], points, packRGB(255, 255, 255));
+			}
 		}
-		else
+		double t_all = secondsSince(start) / N_repeats;
+
+		DisplayList culled_list;
+		OrbitCullStats stats;
+		start = std::chrono::steady_clock::now();
+		for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 		{
-			major_orbits.push_back(getKeplerOrbitPoints(major_pos_eclip[idx_major], major_vel_eclip[idx_major]));
+			culled_list.commands.clear();
+			stats = OrbitCullStats();
+			Frustum frustum = makeFrustum(cam);
+			for (int idx_orbit = 0; idx_orbit < bench.orbits.size(); idx_orbit++)
+			{
+				addVisibleOrbit(culled_list, cam, frustum, *bench.orbits[idx_orbit], points, packRGB(255, 255, 255), &stats);
+			}
 		}
-	}
+		double t_culled = secondsSince(start) / N_repeats;
 
-	// now we can draw images
-	// ========== TOP-DOWN ==========
+		rasterizeDisplayList(img, all_list, nullptr, packRGB(0, 0, 0));
+		uint64_t all_hash = hashFramebuffer(img);
+		rasterizeDisplayList(img, culled_list, nullptr, packRGB(0, 0, 0));
+		uint64_t culled_hash = hashFramebuffer(img);
 
-	// get the extents of the orbit of the minor planet
-	double R_mp_max = 0;
-	for (int idx_op = 0; idx_op < mp_orbit.size(); idx_op++)
-	{
-		double Rsq_current = mp_orbit[idx_op].x * mp_orbit[idx_op].x + mp_orbit[idx_op].y * mp_orbit[idx_op].y;
-		if (Rsq_current > R_mp_max * R_mp_max)
-		{
-			R_mp_max = sqrt(Rsq_current);
-		}
+		std::cout << "    " << bench.cameras[idx_camera].name << " (fov " << bench.cameras[idx_camera].fov_deg << " deg): "
+			<< 100.0 * stats.N_culled / stats.N_segments << "% of " << stats.N_segments << " segments culled, "
+			<< t_all * 1e6 << " -> " << t_culled * 1e6 << " us, identical: "
+			<< (all_hash == culled_hash && all_list.commands.size() == culled_list.commands.size() ? "yes" : "NO") << "\n";
 	}
+}
 
-	// we will push the camera as far back to include the next planet's orbit (unless the minor planet's orbit 
-	// is larger than Neptune's, in which case we will go even farther out)
-	std::vector<double> planet_sma = { 69.8e6, 108.9e6, 152.1e6, 249.3e6, 816.4e6, 1506.5e6, 3001.4e6, 4558.9e6 };
-	double R_max = getNextLargerOrRetain(R_mp_max, planet_sma) * 1.33;
-	double fit_dist = R_max / tan(fov / 2);
+// span disc fill against the old per-pixel test, for the fixed sprite radii and for the Sun up close
+void benchDiscs()
+{
+	int screen_x = 1920;
+	int screen_y = 1080;
 
-	Vec3 cam_pos = Vec3(0, 0, fit_dist);
-	std::vector<Vec3> cam_orient = {
-		Vec3(1, 0, 0),
-		Vec3(0, 1, 0),
-		Vec3(0, 0, 1)
+	// name, radius and how many discs, scattered over (and a bit past) the screen
+	struct DiscBenchCase
+	{
+		std::string name;
+		int radius;
+		int N_discs;
 	};
-
-	std::string save_name = "map_topdown/" + map_name + "_topdown.ppm";
-	renderSolarSystem(st, mp_pos, mp_orbit, major_pos_eclip, major_orbits, cam_mode, fov, screen_x, screen_y, cam_pos, cam_orient, starfield, save_name);
-
-	// ========== EDGE-ON ==========
-	cam_pos = Vec3(fit_dist, 0, 0);
-	cam_orient = {
-		Vec3(0, 1, 0),
-		Vec3(0, 0, 1),
-		Vec3(1, 0, 0)
+	std::vector<DiscBenchCase> cases = {
+		{ "stars", 1, 50000 },
+		{ "planets", 3, 5000 },
+		{ "Sun", 5, 5000 },
+		{ "Sun up close", 400, 20 },
+		{ "Sun filling the screen", 3000, 5 },
+		{ "Sun from its surface", 1000000, 2 }
 	};
 
-	save_name = "map_edgeon/" + map_name + "_edgeon.ppm";
-	renderSolarSystem(st, mp_pos, mp_orbit, major_pos_eclip, major_orbits, cam_mode, fov, screen_x, screen_y, cam_pos, cam_orient, starfield, save_name);
+	std::cout << "Disc fill benchmark: " << screen_x << "x" << screen_y << "\n";
 
-	// ========== CUSTOM ==========
-	cam_pos = -Vec3(cam_theta, cam_phi) * cam_dist;
+	Framebuffer img;
+	img.resize(screen_x, screen_y);
+	ClipRect full = getFullClipRect(img);
+	const int N_repeats = 10;
 
-	if (strcmp(carrier_obj.c_str(), "None")) // NOT equal to "None"
+	for (int idx_case = 0; idx_case < cases.size(); idx_case++)
 	{
-		if (!strcmp(carrier_obj.c_str(), "SOLAR_SYSTEM_BARYCENTER"))
-		{
-			cam_pos = Vec3(0, 0, 0);
-		}
-		else if (!strcmp(carrier_obj.c_str(), "SUN"))
-		{
-			cam_pos = major_pos_eclip[0];
-		}
-		else if (!strcmp(carrier_obj.c_str(), "MERCURY_BARYCENTER"))
-		{
-			cam_pos = major_pos_eclip[1];
-		}
-		else if (!strcmp(carrier_obj.c_str(), "VENUS_BARYCENTER"))
-		{
-			cam_pos = major_pos_eclip[2];
-		}
-		else if (!strcmp(carrier_obj.c_str(), "EARTH_BARYCENTER"))
-		{
-			cam_pos = major_pos_eclip[3];
-		}
-		else if (!strcmp(carrier_obj.c_str(), "MARS_BARYCENTER"))
-		{
-			cam_pos = major_pos_eclip[4];
-		}
-		else if (!strcmp(carrier_obj.c_str(), "JUPITER_BARYCENTER"))
-		{
-			cam_pos = major_pos_eclip[5];
-		}
-		else if (!strcmp(carrier_obj.c_str(), "SATURN_BARYCENTER"))
+		int radius = cases[idx_case].radius;
+
+		// xorshift, the same centers every run
+		std::vector<std::array<int, 2>> centers(cases[idx_case].N_discs);
+		uint32_t state = 2463534242u;
+		for (int idx_disc = 0; idx_disc < centers.size(); idx_disc++)
 		{
-			cam_pos = major_pos_eclip[6];
+			for (int idx_axis = 0; idx_axis < 2; idx_axis++)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				int extent = idx_axis == 0 ? screen_x : screen_y;
+				centers[idx_disc][idx_axis] = (int)(state % (extent + 2 * radius)) - radius;
+			}
 		}
-		else if (!strcmp(carrier_obj.c_str(), "URANUS_BARYCENTER"))
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 		{
-			cam_pos = major_pos_eclip[7];
+			img.clear(packRGB(0, 0, 0));
+			for (int idx_disc = 0; idx_disc < centers.size(); idx_disc++)
+			{
+				drawCircleReference(img, full, centers[idx_disc][0], centers[idx_disc][1], radius, packRGB(255, 255, 255));
+			}
 		}
-		else if (!strcmp(carrier_obj.c_str(), "NEPTUNE_BARYCENTER"))
+		double t_ref = secondsSince(start) / N_repeats;
+		uint64_t ref_hash = hashFramebuffer(img);
+
+		start = std::chrono::steady_clock::now();
+		for (int idx_repeat = 0; idx_repeat < N_repeats; idx_repeat++)
 		{
-			cam_pos = major_pos_eclip[8];
+			img.clear(packRGB(0, 0, 0));
+			for (int idx_disc = 0; idx_disc < centers.size(); idx_disc++)
+			{
+				drawCircle(img, full, centers[idx_disc][0], centers[idx_disc][1], radius, packRGB(255, 255, 255));
+			}
 		}
-		else if (!strcmp(carrier_obj.c_str(), "MP"))
+		double t_span = secondsSince(start) / N_repeats;
+		uint64_t span_hash = hashFramebuffer(img);
+
+		// once more through raster tiles, the span clipping has to line up at the tile edges too
+		img.clear(packRGB(0, 0, 0));
+		for (int tile_y = 0; tile_y < screen_y; tile_y += RASTER_TILE_SIZE)
 		{
-			cam_pos = mp_pos;
+			for (int tile_x = 0; tile_x < screen_x; tile_x += RASTER_TILE_SIZE)
+			{
+				ClipRect clip = { tile_x, tile_y, min(tile_x + RASTER_TILE_SIZE, screen_x), min(tile_y + RASTER_TILE_SIZE, screen_y) };
+				for (int idx_disc = 0; idx_disc < centers.size(); idx_disc++)
+				{
+					drawCircle(img, clip, centers[idx_disc][0], centers[idx_disc][1], radius, packRGB(255, 255, 255));
+				}
+			}
 		}
-	}
+		uint64_t tiled_hash = hashFramebuffer(img);
 
-	Vec3 target_pos = Vec3(0, 0, 0);
-	if (!strcmp(center_obj.c_str(), "SOLAR_SYSTEM_BARYCENTER"))
-	{
-		target_pos = Vec3(0, 0, 0);
+		std::cout << "    " << cases[idx_case].name << " (" << centers.size() << " discs, radius " << radius << "): per-pixel "
+			<< t_ref * 1000 << " ms, spans " << t_span * 1000 << " ms, speedup " << t_ref / t_span << "x, identical: "
+			<< (ref_hash == span_hash && ref_hash == tiled_hash ? "yes" : "NO") << "\n";
 	}
-	else if (!strcmp(center_obj.c_str(), "SUN"))
+}
+
+void runBenchmark(const std::string& bench_name, const std::string& starcatalog_path)
+{
+	if (!strcmp(bench_name.c_str(), "catalog"))
 	{
-		target_pos = major_pos_eclip[0];
+		benchCatalog(starcatalog_path);
 	}
-	else if (!strcmp(center_obj.c_str(), "MERCURY_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "raster"))
 	{
-		target_pos = major_pos_eclip[1];
+		benchRaster(starcatalog_path);
 	}
-	else if (!strcmp(center_obj.c_str(), "VENUS_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "lines"))
 	{
-		target_pos = major_pos_eclip[2];
+		benchLines();
 	}
-	else if (!strcmp(center_obj.c_str(), "EARTH_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "discs"))
 	{
-		target_pos = major_pos_eclip[3];
+		benchDiscs();
 	}
-	else if (!strcmp(center_obj.c_str(), "MARS_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "cull"))
 	{
-		target_pos = major_pos_eclip[4];
+		benchCulling();
 	}
-	else if (!strcmp(center_obj.c_str(), "JUPITER_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "orbits"))
 	{
-		target_pos = major_pos_eclip[5];
+		benchOrbits();
 	}
-	else if (!strcmp(center_obj.c_str(), "SATURN_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "tess"))
 	{
-		target_pos = major_pos_eclip[6];
+		benchTessellation();
 	}
-	else if (!strcmp(center_obj.c_str(), "URANUS_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "elements"))
 	{
-		target_pos = major_pos_eclip[7];
+		benchElements();
 	}
-	else if (!strcmp(center_obj.c_str(), "NEPTUNE_BARYCENTER"))
+	else if (!strcmp(bench_name.c_str(), "population"))
 	{
-		target_pos = major_pos_eclip[8];
+		benchPopulation();
 	}
-	else if (!strcmp(center_obj.c_str(), "MP"))
+	else
 	{
-		target_pos = mp_pos;
+		std::cerr << "Unknown benchmark: " << bench_name << "\n";
 	}
+}
 
-	// dummy default orientation
-	cam_orient = {
-		Vec3(1, 0, 0),
-		Vec3(0, 1, 0),
-		Vec3(0, 0, 1)
-	};
-
-	Vec3 forward = (target_pos - cam_pos).normalized();
-	Vec3 forward_xy = Vec3(forward.x, forward.y, 0).normalized();
-	Vec3 right = Vec3(-forward_xy.y, forward_xy.x, 0);
-	Vec3 up = forward.cross(right).normalized();
-	right = up.cross(forward).normalized();
-
-	cam_orient[0] = right;
-	cam_orient[1] = up;
-	cam_orient[2] = -forward;
-
-	save_name = "map_custom/" + map_name + "_custom.ppm";
-	renderSolarSystem(st, mp_pos, mp_orbit, major_pos_eclip, major_orbits, cam_mode, fov, screen_x, screen_y, cam_pos, cam_orient, starfield, save_name);
+void printBanner()
+{
+	std::cout << "SVIS v0.2.0\n\n";
 }
 
 void printHelpMsg()
@@ -1279,6 +6268,8 @@ void printHelpMsg()
 	std::cout << "    State vector file name: state_vectors.txt\n";
 	std::cout << "    SPICE kernels path: data/SPICE/\n";
 	std::cout << "    Star catalog path: data/Tycho2.csv\n";
+	std::cout << "    Star limiting magnitude: 6\n";
+	std::cout << "        (a binary copy, data/Tycho2.csv.bin, is written on first use and loaded instead of the CSV afterwards)\n";
 	std::cout << "    Field of view: 60 deg\n";
 	std::cout << "    Screen size: 640 x 480\n";
 	std::cout << "    Camera target: SOLAR_SYSTEM_BARYCENTER\n";
@@ -1286,19 +6277,46 @@ void printHelpMsg()
 	std::cout << "    Custom cam. RA: 45 deg\n";
 	std::cout << "    Custom cam. DEC: +45 deg\n";
 	std::cout << "    Custom cam. distance: 15 AU\n";
-	std::cout << "    Image output file prefix: 'map_'\n\n";
+	std::cout << "    Image output file prefix: 'map_'\n";
+	std::cout << "    Planet ephemeris: cache, 1 km tolerance\n";
+	std::cout << "    Render threads: 1\n";
+	std::cout << "    Image writer threads: 1\n";
+	std::cout << "    Tile threads: 1\n";
+	std::cout << "    Image format: ppm (binary P6)\n";
+	std::cout << "    Orbit tessellation: adaptive\n";
+	std::cout << "    Orbit cache tolerance: 0.1 px\n";
+	std::cout << "    Population: None\n\n";
 
 	std::cout << "You can adjust each setting by using the following arguments:\n";
 	std::cout << "    -sv: state vector file path\n";
 	std::cout << "    -spice: SPICE kernels directory path\n";
 	std::cout << "    -catalog: Star catalog file path (enter 'None' for no background stars)\n";
+	std::cout << "    -maglim: Limiting magnitude, dimmer stars are not loaded or drawn\n";
 	std::cout << "    -fov: Field of view in degrees\n";
 	std::cout << "    -center: The object the camera is targeting\n";
 	std::cout << "    -carrier: The object that the camera is travelling with (leave blank or enter 'None' for a camera fixed in space)\n";
 	std::cout << "    -theta: Target RA in degrees if a carrier doesn't exist\n";
 	std::cout << "    -phi: Target DEC in degrees if a carrier doesn't exist\n";
 	std::cout << "    -dist: Cam. distance from centered object if a carrier doesn't exist\n";
-	std::cout << "    -prefix: Image file output prefix\n\n";
+	std::cout << "    -prefix: Image file output prefix\n";
+	std::cout << "    -ephem: Planet ephemeris source: 'cache' (Chebyshev fits of SPICE), 'spice' (SPICE for every epoch) or 'verify' (cache, checked against SPICE)\n";
+	std::cout << "    -ephem_tol: Ephemeris cache error bound in km\n";
+	std::cout << "    -threads: Number of epochs rendered in parallel (SPICE lookups stay on the main thread)\n";
+	std::cout << "    -view: Extra camera, as name,theta,phi,dist[,center[,carrier]] (degrees and AU, center and carrier default to the custom map's)\n";
+	std::cout << "        Can be given several times, images go to map_<name>. All views of an epoch are rendered concurrently when -threads allows.\n";
+	std::cout << "    -tile_threads: Number of threads rasterizing each frame, split into 256 px tiles (helps with single large images)\n";
+	std::cout << "    -write_threads: Number of threads encoding and writing images in the background (0 to do it on the render threads)\n";
+	std::cout << "    -stream: Stream one view (topdown, edgeon or custom) as video frames instead of writing image files\n";
+	std::cout << "    -stream_out: Where the stream goes, a file path or '-' for stdout (the default, messages then go to stderr)\n";
+	std::cout << "    -stream_format: 'y4m' (YUV4MPEG2, 4:2:0) or 'rgb' (raw RGB24 frames, no header)\n";
+	std::cout << "    -fps: Frame rate written into the Y4M header\n";
+	std::cout << "    -format: Image file format: 'ppm' (binary P6), 'ppm_ascii' (plain text P3) or 'png'\n";
+	std::cout << "    -tess: Orbit tessellation: 'adaptive' (subdivided per camera to a quarter pixel) or 'fixed' (720 uniform steps)\n";
+	std::cout << "    -orbit_cache: Pixels an orbit may drift in the closest view before it is sampled again (0 samples every orbit for every epoch)\n";
+	std::cout << "    -population: MPCORB-style orbital element file of minor planets drawn as points behind everything else (enter 'None' for none)\n";
+	std::cout << "        Read once into a binary cache next to it (<file>.bin), rebuilt when the file changes\n";
+	std::cout << "    -jd_time: Take epochs from the JD column (UTC, converted with the leap second kernel) instead of parsing the date strings\n";
+	std::cout << "    -bench: Run a benchmark instead of mapping (catalog, raster, lines, discs, cull, orbits, tess, elements, population)\n\n";
 
 	std::cout << "SVIS always outputs two default maps: the top-down and edge-on view maps of the Solar System. The camera settings only affect a third map called the 'custom' map.\n";
 	std::cout << "Output images will be saved on the corresponding directories: map_topdown, map_edgeon, map_custom.\n\n";
@@ -1309,8 +6327,6 @@ void printHelpMsg()
 
 int main(int argc, char* argv[])
 {
-	std::cout << "SVIS v0.2.0\n\n";
-
 	// default parameters
 	std::string sv_path = "state_vectors.txt";
 	std::string spice_path = "data/SPICE/";
@@ -1329,6 +6345,23 @@ int main(int argc, char* argv[])
 	
 	std::string out_prefix = "map_";
 	std::string starcatalog_path = "data/Tycho2.csv";
+	std::string bench_name = "";
+	double star_mag_limit = 6; // dimmest star drawn
+	EphemerisMode ephem_mode = EphemerisMode::CACHE;
+	double ephem_tolerance = 1.0; // km
+	bool et_from_jd = false; // derive ET from the JD column instead of parsing the UTC strings
+	int N_threads = 1; // epochs rendered at the same time
+	int N_write_threads = 1; // image encoders/writers, 0 to encode and write on the render threads
+	int N_tile_threads = 1; // threads rasterizing the tiles of a single frame
+	std::vector<std::string> extra_view_args; // name,theta,phi,dist[,center[,carrier]] for each extra camera
+	std::string stream_view = ""; // stream this view as video frames instead of writing image files
+	std::string stream_out = "-"; // stdout
+	StreamFormat stream_format = StreamFormat::Y4M;
+	int stream_fps = 30;
+	ImageFormat image_format = ImageFormat::PPM;
+	OrbitTessellation orbit_tess = OrbitTessellation::ADAPTIVE;
+	double orbit_cache_tolerance = 0.1; // px
+	std::string population_path = "None"; // MPCORB-style orbital elements of minor planets drawn as points
 
 	// handle command line arguments
 	// there is a more compact version of doing this but this is easier for my brain
@@ -1387,8 +6420,77 @@ int main(int argc, char* argv[])
 		{
 			argtype = 12;
 		}
+		else if (!strcmp(argv[idx_cmd], "-bench"))
+		{
+			argtype = 13;
+		}
+		else if (!strcmp(argv[idx_cmd], "-maglim"))
+		{
+			argtype = 14;
+		}
+		else if (!strcmp(argv[idx_cmd], "-ephem"))
+		{
+			argtype = 15;
+		}
+		else if (!strcmp(argv[idx_cmd], "-ephem_tol"))
+		{
+			argtype = 16;
+		}
+		else if (!strcmp(argv[idx_cmd], "-jd_time"))
+		{
+			et_from_jd = true;
+		}
+		else if (!strcmp(argv[idx_cmd], "-threads"))
+		{
+			argtype = 17;
+		}
+		else if (!strcmp(argv[idx_cmd], "-format"))
+		{
+			argtype = 18;
+		}
+		else if (!strcmp(argv[idx_cmd], "-write_threads"))
+		{
+			argtype = 19;
+		}
+		else if (!strcmp(argv[idx_cmd], "-stream"))
+		{
+			argtype = 20;
+		}
+		else if (!strcmp(argv[idx_cmd], "-stream_out"))
+		{
+			argtype = 21;
+		}
+		else if (!strcmp(argv[idx_cmd], "-stream_format"))
+		{
+			argtype = 22;
+		}
+		else if (!strcmp(argv[idx_cmd], "-fps"))
+		{
+			argtype = 23;
+		}
+		else if (!strcmp(argv[idx_cmd], "-tile_threads"))
+		{
+			argtype = 24;
+		}
+		else if (!strcmp(argv[idx_cmd], "-view"))
+		{
+			argtype = 25;
+		}
+		else if (!strcmp(argv[idx_cmd], "-tess"))
+		{
+			argtype = 26;
+		}
+		else if (!strcmp(argv[idx_cmd], "-orbit_cache"))
+		{
+			argtype = 27;
+		}
+		else if (!strcmp(argv[idx_cmd], "-population"))
+		{
+			argtype = 28;
+		}
 		else if (!strcmp(argv[idx_cmd], "-h") || !strcmp(argv[idx_cmd], "--help")) // two dashes because people are more used to it
 		{
+			printBanner();
 			printHelpMsg();
 			return 0;
 		}
@@ -1434,51 +6536,285 @@ int main(int argc, char* argv[])
 				break;
 			case 12:
 				screen_y = atoi(argv[idx_cmd]);;
+				break;
+			case 13:
+				bench_name = argv[idx_cmd];
+				break;
+			case 14:
+				star_mag_limit = strtod(argv[idx_cmd], NULL);
+				break;
+			case 15:
+				if (!strcmp(argv[idx_cmd], "spice"))
+				{
+					ephem_mode = EphemerisMode::SPICE;
+				}
+				else if (!strcmp(argv[idx_cmd], "verify"))
+				{
+					ephem_mode = EphemerisMode::VERIFY;
+				}
+				else
+				{
+					ephem_mode = EphemerisMode::CACHE;
+				}
+				break;
+			case 16:
+				ephem_tolerance = strtod(argv[idx_cmd], NULL);
+				break;
+			case 17:
+				N_threads = atoi(argv[idx_cmd]);
+				break;
+			case 18:
+				if (!strcmp(argv[idx_cmd], "png"))
+				{
+					image_format = ImageFormat::PNG;
+				}
+				else if (!strcmp(argv[idx_cmd], "ppm_ascii"))
+				{
+					image_format = ImageFormat::PPM_ASCII;
+				}
+				else
+				{
+					image_format = ImageFormat::PPM;
+				}
+				break;
+			case 19:
+				N_write_threads = max(0, atoi(argv[idx_cmd]));
+				break;
+			case 20:
+				stream_view = argv[idx_cmd];
+				break;
+			case 21:
+				stream_out = argv[idx_cmd];
+				break;
+			case 22:
+				if (!strcmp(argv[idx_cmd], "rgb"))
+				{
+					stream_format = StreamFormat::RGB;
+				}
+				else
+				{
+					stream_format = StreamFormat::Y4M;
+				}
+				break;
+			case 23:
+				stream_fps = max(1, atoi(argv[idx_cmd]));
+				break;
+			case 24:
+				N_tile_threads = max(1, atoi(argv[idx_cmd]));
+				break;
+			case 25:
+				extra_view_args.push_back(argv[idx_cmd]);
+				break;
+			case 26:
+				if (!strcmp(argv[idx_cmd], "fixed"))
+				{
+					orbit_tess = OrbitTessellation::FIXED;
+				}
+				else
+				{
+					orbit_tess = OrbitTessellation::ADAPTIVE;
+				}
+				break;
+			case 27:
+				orbit_cache_tolerance = max(0, strtod(argv[idx_cmd], NULL));
+				break;
+			case 28:
+				population_path = argv[idx_cmd];
+			}
+		}
+	}
+
+	// the custom view first, then the extra cameras, which take their center and carrier from it unless told otherwise
+	std::vector<ViewSpec> custom_views = { ViewSpec{ "custom", cam_theta, cam_phi, cam_dist, center_obj, carrier_obj } };
+	for (int idx_view = 0; idx_view < extra_view_args.size(); idx_view++)
+	{
+		ViewSpec spec;
+		if (!parseViewSpec(extra_view_args[idx_view], custom_views[0], spec))
+		{
+			std::cerr << "Invalid -view '" << extra_view_args[idx_view] << "', expected name,theta,phi,dist[,center[,carrier]]\n";
+			return 1;
+		}
+
+		for (int idx_other = 0; idx_other < custom_views.size(); idx_other++)
+		{
+			if (spec.name == custom_views[idx_other].name || spec.name == "topdown" || spec.name == "edgeon")
+			{
+				std::cerr << "View name '" << spec.name << "' is already taken\n";
+				return 1;
 			}
 		}
+		custom_views.push_back(spec);
+	}
+
+	// when the frames go to stdout, everything we would normally print there goes to stderr instead
+	if (!stream_view.empty() && stream_out == "-")
+	{
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+
+	printBanner();
+
+	if (!bench_name.empty())
+	{
+		runBenchmark(bench_name, starcatalog_path);
+		return 0;
 	}
 
+	std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
+
 	std::cout << "Loading SPICE kernels... ";
 	loadAllKernels(spice_path);
+	pxform_c("J2000", "ECLIPJ2000", 0, equ_ecl_rot);
 	std::cout << "Done.\n";
+	double t_kernels = secondsSince(stage_start);
 
-	std::tuple<std::vector<double>, std::vector<double>, std::vector<double>> starfield;
+	stage_start = std::chrono::steady_clock::now();
+	Starfield starfield;
 
 	if (strcmp(starcatalog_path.c_str(), "None"))
 	{
 		std::cout << "Reading star catalogue... ";
-		starfield = readTycho2(starcatalog_path);
+		starfield = loadStarCatalog(starcatalog_path, star_mag_limit);
 		std::cout << "Done.\n";
 	}
 	else
 	{
 		std::cout << "No star catalog provided, skybox will be empty.\n";
 	}
+	double t_catalog = secondsSince(stage_start);
 
-	std::cout << "Reading state vector data... ";
-	std::vector<State> states = readStateVectorFile(sv_path);
-	std::cout << "Done.\n";
+	stage_start = std::chrono::steady_clock::now();
+	Population population;
+
+	if (strcmp(population_path.c_str(), "None"))
+	{
+		std::cout << "Reading minor planet population... ";
+		population = loadPopulation(population_path);
+		std::cout << "Done, " << population.size() << " objects.\n";
+	}
+	double t_population = secondsSince(stage_start);
+
+	LeapSecondTable leap_seconds;
+	if (et_from_jd && !leap_seconds.load())
+	{
+		std::cerr << "No leap second kernel in the pool, epochs will be read from the UTC strings instead.\n";
+		et_from_jd = false;
+	}
+
+	std::cout << "Streaming state vector data from " << sv_path << "\n";
+	StateVectorStream states(sv_path, et_from_jd ? &leap_seconds : nullptr);
+
+	EphemerisCache ephemeris(ephem_mode, ephem_tolerance);
+	OrbitCache orbit_cache(orbit_cache_tolerance, fov, screen_x, screen_y, custom_views);
 
+	stage_start = std::chrono::steady_clock::now();
 	std::cout << "Mapping the Solar System...\n";
-	createDirectoryIfNotExists("map_topdown");
-	createDirectoryIfNotExists("map_edgeon");
-	createDirectoryIfNotExists("map_custom");
-	// sanitize ephemeris point data and generate an image for each ephemeris point
-	for (int idx_state = 0; idx_state < states.size(); idx_state++)
+
+	FrameStream frame_stream;
+	FrameStream* stream = nullptr;
+	if (!stream_view.empty())
 	{
-		std::cout << "    Map " << idx_state + 1 << " / " << states.size() << "...\n";
-		State s = states[idx_state];
+		bool view_exists = stream_view == "topdown" || stream_view == "edgeon";
+		for (int idx_view = 0; idx_view < custom_views.size(); idx_view++)
+		{
+			view_exists = view_exists || stream_view == custom_views[idx_view].name;
+		}
+
+		if (!view_exists)
+		{
+			std::cerr << "Unknown view to stream: " << stream_view << " (topdown, edgeon, custom or one given with -view)\n";
+			return 1;
+		}
 
-		// get ephem time from UTC string
-		SpiceDouble et;
-		utc2et_c(s.datetime.c_str(), &et);
+		if (!frame_stream.open(stream_out, stream_view, stream_format, stream_fps, screen_x, screen_y))
+		{
+			return 1;
+		}
+		stream = &frame_stream;
+		std::cout << "Streaming the " << stream_view << " view to " << (stream_out == "-" ? "stdout" : stream_out) << "\n";
+	}
+	else
+	{
+		createDirectoryIfNotExists("map_topdown");
+		createDirectoryIfNotExists("map_edgeon");
+		for (int idx_view = 0; idx_view < custom_views.size(); idx_view++)
+		{
+			createDirectoryIfNotExists("map_" + custom_views[idx_view].name);
+		}
+	}
+	// sanitize ephemeris point data and generate an image for each ephemeris point
+	// (states keep arriving from the reader thread while we render)
+	// with a single thread everything runs inline, just like before
+	// every render thread gets a framebuffer to draw in, plus two per writer thread for the queue
+	ImageWriter image_writer(N_write_threads, max(1, N_threads) + 2 * N_write_threads);
+	WorkerPool render_pool(N_threads > 1 ? N_threads : 0, 2 * N_threads);
+	// the thread rendering a frame helps rasterize its own tiles, so one fewer helper is needed
+	WorkerPool tile_pool(max(0, N_tile_threads - 1), 4 * N_tile_threads);
+
+	int N_states = 0;
+	double t_first_state = 0;
+	double t_scenes = 0;
+	State s;
+	while (states.next(s))
+	{
+		if (N_states == 0)
+		{
+			t_first_state = secondsSince(stage_start);
+		}
+		N_states++;
+		std::cout << "    Map " << N_states << " (" << s.datetime << ")...\n";
 
 		std::string suffix = s.datetime;
 		std::replace(suffix.begin(), suffix.end(), ':', '_'); // keep the OS happy
 		std::string map_name = "map_" + suffix;
-		mapSS3D(s, starfield, cam_mode, cam_dist, cam_theta, cam_phi, fov, center_obj, carrier_obj, map_name, screen_x, screen_y);
+
+		// SPICE lookups and orbit sampling happen here, in order, the views are drawn and saved by the workers
+		std::chrono::steady_clock::time_point scene_start = std::chrono::steady_clock::now();
+		std::shared_ptr<const Scene> scene = std::make_shared<const Scene>(buildScene(s, starfield, population.size() > 0 ? &population : nullptr, ephemeris, orbit_cache));
+		t_scenes += secondsSince(scene_start);
+
+		long long frame_idx = N_states - 1;
+		render_pool.submit([=, &image_writer, &render_pool, &tile_pool, &custom_views]() {
+			mapSS3D(image_writer, &render_pool, &tile_pool, *scene, cam_mode, fov, orbit_tess, custom_views, map_name, screen_x, screen_y, image_format,
+				stream, frame_idx);
+		});
+	}
+	render_pool.wait();
+	image_writer.wait();
+	if (stream)
+	{
+		frame_stream.close();
+		std::cout << "Streamed " << frame_stream.N_frames_written << " frames.\n";
 	}
 	std::cout << "Done generating charts.\n";
+	double t_mapping = secondsSince(stage_start);
+
+	std::cout << "Stage timings:\n";
+	std::cout << "    SPICE kernels: " << t_kernels << " s\n";
+	std::cout << "    Star catalogue: " << t_catalog << " s\n";
+	if (population.size() > 0)
+	{
+		std::cout << "    Population (" << population.size() << " objects): " << t_population << " s\n";
+	}
+	std::cout << "    State vectors (" << N_states << " states, epochs from " << (et_from_jd ? "JD" : "UTC strings") << "): "
+		<< states.parse_time << " s, overlapped with mapping (first state ready after " << t_first_state << " s)\n";
+	std::cout << "    Mapping: " << t_mapping << " s (" << t_scenes << " s of it building scenes on the main thread, "
+		<< max(1, N_threads) << " render threads, " << N_tile_threads << " tile threads per frame)\n";
+	std::cout << "    Image output (" << image_writer.N_images << " images, " << image_writer.getThreadCount() << " writer threads): "
+		<< image_writer.encode_time << " s encoding, " << image_writer.write_time << " s writing";
+	if (image_writer.getThreadCount() > 0)
+	{
+		// done inline, all of that would have stalled the renderers
+		std::cout << ", moved off the render threads (" << image_writer.stall_time << " s spent waiting for a free framebuffer)\n";
+	}
+	else
+	{
+		std::cout << ", inline on the render threads (" << 100 * (image_writer.encode_time + image_writer.write_time) / t_mapping
+			<< "% of the mapping time)\n";
+	}
+	ephemeris.printSummary();
+	orbit_cache.printSummary();
+	std::cout << "Peak memory usage: " << getPeakMemoryUsage() / (1024 * 1024) << " MB\n";
 
 	std::cout << "Program end.\n\n";
 	return 0;